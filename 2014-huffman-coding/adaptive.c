@@ -0,0 +1,87 @@
+#include <stdlib.h>
+
+#include "adaptive.h"
+
+/*
+ * Rebuilds the code of model m from its current counts.
+ */
+static void rebuild(huffman_model_t *m) {
+  huffman_code_build(&m->code, m->counts);
+  huffman_decode_table_build(&m->table, &m->code);
+}
+
+/*
+ * Resets m to a flat distribution over every symbol.
+ */
+void huffman_model_init(huffman_model_t *m) {
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+    m->counts[c] = 1;
+  }
+  m->total = HUFFMAN_SYMBOLS;
+  m->interval = m->until_rebuild = ADAPTIVE_FIRST_INTERVAL;
+  rebuild(m);
+}
+
+/*
+ * Counts one occurrence of symbol c, rebuilding the code if it is due.
+ */
+static void update(huffman_model_t *m, uint8_t c) {
+  m->counts[c]++;
+  m->total++;
+
+  if (--m->until_rebuild > 0) {
+    return;
+  }
+
+  if (m->total > ADAPTIVE_MAX_TOTAL) {
+    m->total = 0;
+    for (int i = 0; i < HUFFMAN_SYMBOLS; i++) {
+      // every symbol keeps a code, so a count never drops to zero
+      m->counts[i] = (m->counts[i] >> 1) | 1;
+      m->total += m->counts[i];
+    }
+  }
+  if (m->interval < ADAPTIVE_MAX_INTERVAL) {
+    m->interval <<= 1;
+  }
+  m->until_rebuild = m->interval;
+  rebuild(m);
+}
+
+/*
+ * Encodes the n bytes of in into out, updating the model after every symbol,
+ * and returns the number of bytes written. The final byte is padded with zero
+ * bits.
+ *
+ * Pre: out has room for HUFFMAN_ENCODED_BOUND(n) bytes.
+ */
+size_t huffman_adaptive_encode(huffman_model_t *m, const uint8_t *in,
+                               size_t n, uint8_t *out) {
+  huffman_writer_t w;
+  huffman_writer_init(&w, out);
+  for (size_t i = 0; i < n; i++) {
+    huffman_write_symbol(&w, &m->code, in[i]);
+    update(m, in[i]);
+  }
+  return huffman_writer_finish(&w) - out;
+}
+
+/*
+ * Decodes n symbols from the len bytes of in into out, updating the model in
+ * step with huffman_adaptive_encode. Returns 0 on success or -1 if in runs
+ * out or contains an invalid code.
+ */
+int huffman_adaptive_decode(huffman_model_t *m, const uint8_t *in, size_t len,
+                            uint8_t *out, size_t n) {
+  size_t bit = 0, end = len * 8;
+
+  for (size_t i = 0; i < n; i++) {
+    int c = huffman_decode_symbol(&m->table, in, &bit, end);
+    if (c < 0) {
+      return -1;
+    }
+    out[i] = (uint8_t) c;
+    update(m, out[i]);
+  }
+  return 0;
+}
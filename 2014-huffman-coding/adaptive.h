@@ -0,0 +1,40 @@
+#ifndef __ADAPTIVE_H
+#define __ADAPTIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codec.h"
+
+/*
+ * Adaptive Huffman model. The encoder and decoder both start from a flat
+ * distribution and count every symbol as it is coded; the code is rebuilt
+ * after a fixed schedule of symbols, so both sides always agree on it without
+ * any table being transmitted.
+ */
+
+/*
+ * The code is rebuilt after ADAPTIVE_FIRST_INTERVAL symbols, then after twice
+ * as many, and so on up to ADAPTIVE_MAX_INTERVAL. Counts are halved once
+ * their total passes ADAPTIVE_MAX_TOTAL so that the model keeps tracking
+ * changes in the input.
+ */
+enum { ADAPTIVE_FIRST_INTERVAL = 32 };
+enum { ADAPTIVE_MAX_INTERVAL = 4096 };
+enum { ADAPTIVE_MAX_TOTAL = 1 << 16 };
+
+typedef struct huffman_model {
+  uint32_t counts[HUFFMAN_SYMBOLS];
+  uint32_t total;
+  size_t interval, until_rebuild;
+  huffman_code_t code;
+  huffman_decode_table_t table;
+} huffman_model_t;
+
+void huffman_model_init(huffman_model_t *);
+size_t huffman_adaptive_encode(huffman_model_t *, const uint8_t *, size_t,
+                               uint8_t *);
+int huffman_adaptive_decode(huffman_model_t *, const uint8_t *, size_t,
+                            uint8_t *, size_t);
+
+#endif
@@ -0,0 +1,90 @@
+#include <stdlib.h>
+
+#include "arena.h"
+
+/*
+ * Orders leaves by count, breaking ties by symbol so that encoder and decoder
+ * always build the same tree.
+ */
+static int compare_leaves(const void *p, const void *q) {
+  const huffman_node_t *a = p, *b = q;
+  if (a->count != b->count) {
+    return a->count < b->count ? -1 : 1;
+  }
+  return a->symbol - b->symbol;
+}
+
+/*
+ * Builds the Huffman tree for the symbol frequencies in counts into a,
+ * replacing whatever it held. Symbols with a count of zero are left out.
+ *
+ * Post:  a->size is 0 if every count is zero, and 2n - 1 for n symbols
+ *        otherwise.
+ */
+void huffman_arena_build(huffman_arena_t *a, const uint32_t *counts) {
+  huffman_node_t *nodes = a->nodes;
+  int n = 0;
+
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+    if (counts[c]) {
+      nodes[n].count = counts[c];
+      nodes[n].left = nodes[n].right = -1;
+      nodes[n].symbol = c;
+      n++;
+    }
+  }
+  qsort(nodes, n, sizeof(huffman_node_t), compare_leaves);
+
+  // Internal nodes are created in order of increasing count, so the two
+  // lightest trees are always at the front of either the leaves or the
+  // internal nodes.
+  int leaf = 0, inner = n, size = n;
+  while (size < 2 * n - 1) {
+    int pick[2];
+    for (int i = 0; i < 2; i++) {
+      if (leaf < n &&
+          (inner == size || nodes[leaf].count <= nodes[inner].count)) {
+        pick[i] = leaf++;
+      } else {
+        pick[i] = inner++;
+      }
+    }
+
+    nodes[size].count = nodes[pick[0]].count + nodes[pick[1]].count;
+    nodes[size].left = pick[0];
+    nodes[size].right = pick[1];
+    nodes[size].symbol = 0;
+    size++;
+  }
+  a->size = size;
+}
+
+/*
+ * Stores the depth of each leaf of a in the entry for its symbol in depths
+ * and returns the greatest depth. Symbols not in the tree are left unchanged.
+ * A tree with a single leaf gives it a depth of 1.
+ */
+int huffman_arena_depths(const huffman_arena_t *a, uint8_t *depths) {
+  uint8_t depth[HUFFMAN_MAX_NODES];
+  int max = 0;
+
+  if (a->size == 0) {
+    return 0;
+  }
+
+  // walk from the root down; parents always come after their children
+  depth[a->size - 1] = 0;
+  for (int i = a->size - 1; i >= 0; i--) {
+    const huffman_node_t *node = &a->nodes[i];
+    if (node->left < 0) {
+      int d = depth[i] ? depth[i] : 1;
+      depths[node->symbol] = d;
+      if (d > max) {
+        max = d;
+      }
+    } else {
+      depth[node->left] = depth[node->right] = depth[i] + 1;
+    }
+  }
+  return max;
+}
@@ -0,0 +1,38 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stdint.h>
+
+#include "codec.h"
+
+/*
+ * A Huffman tree stored in a single array. Nodes refer to their children by
+ * index rather than by pointer, so a whole tree is built in one block of
+ * memory and freed with it.
+ *
+ * A tree over n symbols has exactly 2n - 1 nodes: the n leaves come first,
+ * in order of increasing count, followed by the internal nodes in the order
+ * they were created. Every child therefore has a lower index than its parent
+ * and the root is the last node.
+ */
+
+enum { HUFFMAN_MAX_NODES = 2 * HUFFMAN_SYMBOLS - 1 };
+
+/*
+ * Children are -1 in a leaf.
+ */
+typedef struct huffman_node {
+  uint32_t count;
+  int16_t left, right;
+  uint8_t symbol;
+} huffman_node_t;
+
+typedef struct huffman_arena {
+  int size;
+  huffman_node_t nodes[HUFFMAN_MAX_NODES];
+} huffman_arena_t;
+
+void huffman_arena_build(huffman_arena_t *, const uint32_t *);
+int huffman_arena_depths(const huffman_arena_t *, uint8_t *);
+
+#endif
@@ -0,0 +1,448 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "codec.h"
+#include "interleave.h"
+#include "stream.h"
+
+/*
+ * Compression benchmark. Without arguments it runs over a set of generated
+ * corpora; otherwise over the files named on the command line. For each input
+ * it times the histogram, table build, encode and decode phases of block
+ * coding separately, then compares the stream modes end to end.
+ *
+ * Usage: bench [-s size] [file...]
+ */
+
+enum { DEFAULT_CORPUS_SIZE = 16 << 20 };
+
+/*
+ * Each phase is repeated until it has run for at least this long.
+ */
+static const double MIN_PHASE_TIME = 0.2;
+
+typedef struct buffer {
+  uint8_t *data;
+  size_t len, cap;
+} buffer_t;
+
+static void buffer_append(void *ctx, const uint8_t *data, size_t len) {
+  buffer_t *b = ctx;
+  if (b->len + len > b->cap) {
+    b->cap = 2 * (b->len + len);
+    b->data = realloc(b->data, b->cap);
+    if (b->data == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *checked_malloc(size_t size) {
+  void *p = malloc(size);
+  if (p == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+/*
+ * Corpus generators. All of them are driven by the same fixed-seed xorshift
+ * generator, so every run benchmarks identical data.
+ */
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+/*
+ * Fills cdf with the cumulative Zipf distribution of exponent s over n ranks.
+ */
+static void zipf_cdf(double *cdf, int n, double s) {
+  double total = 0;
+  for (int k = 0; k < n; k++) {
+    total += 1.0 / pow(k + 1, s);
+    cdf[k] = total;
+  }
+  for (int k = 0; k < n; k++) {
+    cdf[k] /= total;
+  }
+}
+
+static int zipf_sample(const double *cdf, int n) {
+  double u = (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+  int lo = 0, hi = n - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (cdf[mid] < u) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/*
+ * English-like text: Zipf-distributed words from a fixed vocabulary, with
+ * occasional punctuation and line breaks.
+ */
+static void generate_text(uint8_t *out, size_t len) {
+  static const char *words[] = {
+    "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as",
+    "was", "with", "be", "by", "on", "not", "he", "this", "are", "or", "his",
+    "from", "at", "which", "but", "have", "an", "had", "they", "you", "were",
+    "their", "one", "all", "we", "can", "her", "has", "there", "been", "if",
+    "more", "when", "will", "would", "who", "so", "no", "huffman", "tree",
+    "code", "region", "image", "stream", "block", "symbol", "frequency"
+  };
+  enum { WORDS = sizeof(words) / sizeof(words[0]) };
+  double cdf[WORDS];
+  zipf_cdf(cdf, WORDS, 1.1);
+
+  size_t i = 0;
+  int column = 0;
+  while (i < len) {
+    const char *w = words[zipf_sample(cdf, WORDS)];
+    for (; *w && i < len; w++, column++) {
+      out[i++] = *w;
+    }
+    if (i == len) {
+      break;
+    }
+
+    uint64_t r = rng_next() % 100;
+    if (r < 6) {
+      out[i++] = r < 4 ? ',' : '.';
+      column++;
+    }
+    if (i < len) {
+      out[i++] = column > 72 ? '\n' : ' ';
+      column = column > 72 ? 0 : column + 1;
+    }
+  }
+}
+
+/*
+ * Bytes whose ranks follow a Zipf distribution, with the ranks scattered
+ * over the byte values.
+ */
+static void generate_zipf(uint8_t *out, size_t len) {
+  double cdf[HUFFMAN_SYMBOLS];
+  zipf_cdf(cdf, HUFFMAN_SYMBOLS, 1.0);
+  for (size_t i = 0; i < len; i++) {
+    out[i] = (uint8_t) (zipf_sample(cdf, HUFFMAN_SYMBOLS) * 167);
+  }
+}
+
+static void generate_uniform(uint8_t *out, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    out[i] = (uint8_t) (rng_next() >> 56);
+  }
+}
+
+static void generate_single(uint8_t *out, size_t len) {
+  memset(out, 'a', len);
+}
+
+typedef struct corpus {
+  const char *name;
+  void (*generate)(uint8_t *, size_t);
+} corpus_t;
+
+static const corpus_t corpora[] = {
+  { "text", generate_text },
+  { "zipf", generate_zipf },
+  { "uniform", generate_uniform },
+  { "single", generate_single }
+};
+
+/*
+ * Per-block state shared between the phases of bench_phases, with the input
+ * they code. Coded blocks are kept PACKED_STRIDE bytes apart.
+ */
+enum {
+  PACKED_STRIDE = HUFFMAN_ENCODED_BOUND(HUFFMAN_BLOCK_SIZE) +
+                  INTERLEAVE_HEADER_SIZE + INTERLEAVE_STREAMS
+};
+
+typedef struct blocks {
+  const buffer_t *input;
+  size_t count;
+  uint32_t (*counts)[HUFFMAN_SYMBOLS];
+  huffman_code_t *codes;
+  uint8_t *packed, *packed4;
+  size_t *packed_len, *packed4_len;
+  uint8_t *unpacked;
+} blocks_t;
+
+static size_t block_len(const buffer_t *input, size_t b) {
+  size_t len = input->len - b * HUFFMAN_BLOCK_SIZE;
+  return len < HUFFMAN_BLOCK_SIZE ? len : HUFFMAN_BLOCK_SIZE;
+}
+
+static void phase_histogram(blocks_t *bl) {
+  const buffer_t *input = bl->input;
+  for (size_t b = 0; b < bl->count; b++) {
+    memset(bl->counts[b], 0, sizeof(bl->counts[b]));
+    huffman_histogram(input->data + b * HUFFMAN_BLOCK_SIZE,
+                      block_len(input, b), bl->counts[b]);
+  }
+}
+
+static void phase_build(blocks_t *bl) {
+  for (size_t b = 0; b < bl->count; b++) {
+    huffman_code_build(&bl->codes[b], bl->counts[b]);
+  }
+}
+
+static void phase_encode(blocks_t *bl) {
+  const buffer_t *input = bl->input;
+  for (size_t b = 0; b < bl->count; b++) {
+    bl->packed_len[b] =
+      huffman_block_encode(&bl->codes[b], input->data + b * HUFFMAN_BLOCK_SIZE,
+                           block_len(input, b), bl->packed + b * PACKED_STRIDE);
+  }
+}
+
+static void phase_encode4(blocks_t *bl) {
+  const buffer_t *input = bl->input;
+  for (size_t b = 0; b < bl->count; b++) {
+    bl->packed4_len[b] =
+      huffman_block_encode4(&bl->codes[b],
+                            input->data + b * HUFFMAN_BLOCK_SIZE,
+                            block_len(input, b),
+                            bl->packed4 + b * PACKED_STRIDE);
+  }
+}
+
+static void decode_failed(size_t b) {
+  fprintf(stderr, "block %zu failed to decode\n", b);
+  exit(EXIT_FAILURE);
+}
+
+static void phase_decode(blocks_t *bl) {
+  const buffer_t *input = bl->input;
+  for (size_t b = 0; b < bl->count; b++) {
+    huffman_decode_table_t table;
+    huffman_decode_table_build(&table, &bl->codes[b]);
+    if (huffman_block_decode(&table, bl->packed + b * PACKED_STRIDE,
+                             bl->packed_len[b],
+                             bl->unpacked + b * HUFFMAN_BLOCK_SIZE,
+                             block_len(input, b))) {
+      decode_failed(b);
+    }
+  }
+}
+
+static void phase_decode_lookup(blocks_t *bl) {
+  const buffer_t *input = bl->input;
+  for (size_t b = 0; b < bl->count; b++) {
+    huffman_lookup_t lookup;
+    huffman_lookup_build(&lookup, &bl->codes[b]);
+    if (huffman_block_decode_lookup(&lookup, bl->packed + b * PACKED_STRIDE,
+                                    bl->packed_len[b],
+                                    bl->unpacked + b * HUFFMAN_BLOCK_SIZE,
+                                    block_len(input, b))) {
+      decode_failed(b);
+    }
+  }
+}
+
+static void phase_decode4(blocks_t *bl) {
+  const buffer_t *input = bl->input;
+  for (size_t b = 0; b < bl->count; b++) {
+    huffman_lookup_t lookup;
+    huffman_lookup_build(&lookup, &bl->codes[b]);
+    if (huffman_block_decode4(&lookup, bl->packed4 + b * PACKED_STRIDE,
+                              bl->packed4_len[b],
+                              bl->unpacked + b * HUFFMAN_BLOCK_SIZE,
+                              block_len(input, b))) {
+      decode_failed(b);
+    }
+  }
+}
+
+/*
+ * Runs phase repeatedly for at least MIN_PHASE_TIME and prints its
+ * throughput over the input.
+ */
+static void time_phase(const char *name, void (*phase)(blocks_t *),
+                       blocks_t *bl) {
+  int runs = 0;
+  double start = now(), elapsed;
+  do {
+    phase(bl);
+    runs++;
+    elapsed = now() - start;
+  } while (elapsed < MIN_PHASE_TIME);
+
+  printf("  %-10s %9.1f MB/s\n", name,
+         runs * (bl->input->len / 1e6) / elapsed);
+}
+
+/*
+ * Times a decode phase and checks that it reproduced the input.
+ */
+static void time_decode(const char *name, void (*phase)(blocks_t *),
+                        blocks_t *bl) {
+  const buffer_t *input = bl->input;
+  memset(bl->unpacked, 0, input->len);
+  time_phase(name, phase, bl);
+  if (memcmp(bl->unpacked, input->data, input->len)) {
+    fprintf(stderr, "%s: block round trip failed\n", name);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*
+ * Times each phase of static block coding separately. The decode phases are,
+ * in turn, the canonical bit-at-a-time decoder, the single lookup table
+ * decoder and the four-way interleaved decoder.
+ */
+static void bench_phases(const buffer_t *input) {
+  blocks_t bl;
+  bl.input = input;
+  bl.count = (input->len + HUFFMAN_BLOCK_SIZE - 1) / HUFFMAN_BLOCK_SIZE;
+  bl.counts = checked_malloc(bl.count * sizeof(*bl.counts));
+  bl.codes = checked_malloc(bl.count * sizeof(*bl.codes));
+  bl.packed = checked_malloc(bl.count * PACKED_STRIDE);
+  bl.packed4 = checked_malloc(bl.count * PACKED_STRIDE);
+  bl.packed_len = checked_malloc(bl.count * sizeof(*bl.packed_len));
+  bl.packed4_len = checked_malloc(bl.count * sizeof(*bl.packed4_len));
+  bl.unpacked = checked_malloc(input->len);
+
+  time_phase("histogram", phase_histogram, &bl);
+  time_phase("build", phase_build, &bl);
+  time_phase("encode", phase_encode, &bl);
+  time_phase("encode4", phase_encode4, &bl);
+  time_decode("decode", phase_decode, &bl);
+  time_decode("lookup", phase_decode_lookup, &bl);
+  time_decode("decode4", phase_decode4, &bl);
+
+  size_t packed = 0;
+  for (size_t b = 0; b < bl.count; b++) {
+    packed += bl.packed_len[b] + HUFFMAN_LENGTHS_SIZE;
+  }
+  printf("  %-10s %9.3f (payload and code lengths)\n", "ratio",
+         (double) input->len / packed);
+
+  free(bl.counts);
+  free(bl.codes);
+  free(bl.packed);
+  free(bl.packed4);
+  free(bl.packed_len);
+  free(bl.packed4_len);
+  free(bl.unpacked);
+}
+
+/*
+ * Times a complete round trip through the stream coder in the given mode.
+ */
+static void bench_mode(const char *name, huffman_mode_t mode,
+                       const buffer_t *input) {
+  buffer_t packed = { NULL, 0, 0 }, unpacked = { NULL, 0, 0 };
+
+  double start = now();
+  huffman_encoder_t *enc = huffman_encoder_init(mode, buffer_append, &packed);
+  huffman_encoder_feed(enc, input->data, input->len);
+  huffman_encoder_finish(enc);
+  double encoded = now();
+
+  huffman_decoder_t *dec = huffman_decoder_init(buffer_append, &unpacked);
+  huffman_decoder_feed(dec, packed.data, packed.len);
+  huffman_error_t err = huffman_decoder_finish(dec);
+  double decoded = now();
+
+  if (err || unpacked.len != input->len ||
+      memcmp(unpacked.data, input->data, input->len)) {
+    fprintf(stderr, "%s: round trip failed\n", name);
+    exit(EXIT_FAILURE);
+  }
+
+  double mb = input->len / 1e6;
+  printf("  %-11s ratio %6.3f  encode %8.1f MB/s  decode %8.1f MB/s\n", name,
+         (double) input->len / packed.len, mb / (encoded - start),
+         mb / (decoded - encoded));
+  free(packed.data);
+  free(unpacked.data);
+}
+
+static void bench(const char *name, const buffer_t *input) {
+  printf("%s (%zu bytes)\n", name, input->len);
+  bench_phases(input);
+  bench_mode("static", HUFFMAN_STATIC, input);
+  bench_mode("interleaved", HUFFMAN_INTERLEAVED, input);
+  bench_mode("order1", HUFFMAN_ORDER1, input);
+  bench_mode("adaptive", HUFFMAN_ADAPTIVE, input);
+}
+
+static int load(const char *filename, buffer_t *b) {
+  FILE *in = fopen(filename, "rb");
+  if (in == NULL) {
+    perror(filename);
+    return -1;
+  }
+  uint8_t chunk[1 << 16];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+    buffer_append(b, chunk, n);
+  }
+  fclose(in);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  size_t size = DEFAULT_CORPUS_SIZE;
+  int first = 1;
+
+  if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+    size = strtoul(argv[2], NULL, 10);
+    first = 3;
+  }
+  if (size == 0) {
+    fprintf(stderr, "Usage: %s [-s size] [file...]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (first == argc) {
+    buffer_t input = { checked_malloc(size), size, size };
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+      rng_state = 0x9e3779b97f4a7c15ull;
+      corpora[i].generate(input.data, input.len);
+      bench(corpora[i].name, &input);
+    }
+    free(input.data);
+  }
+
+  for (int i = first; i < argc; i++) {
+    buffer_t input = { NULL, 0, 0 };
+    if (load(argv[i], &input)) {
+      return EXIT_FAILURE;
+    }
+    if (input.len > 0) {
+      bench(argv[i], &input);
+    }
+    free(input.data);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+#ifndef __BITREADER_H
+#define __BITREADER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "codec.h"
+
+/*
+ * A most-significant-bit-first reader over one coded stream, shared by the
+ * table-driven decoders. bits holds the next count bits of the stream, left
+ * aligned; a refill tops it up to at least 56 bits while input remains, which
+ * is enough for four symbols of HUFFMAN_MAX_BITS.
+ */
+typedef struct bit_reader {
+  const uint8_t *p, *end;
+  uint64_t bits;
+  int count;
+} bit_reader_t;
+
+static inline uint64_t load_be64(const uint8_t *p) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return __builtin_bswap64(v);
+#else
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+#endif
+}
+
+static inline void bit_reader_init(bit_reader_t *br, const uint8_t *p,
+                                   size_t len) {
+  br->p = p;
+  br->end = p + len;
+  br->bits = 0;
+  br->count = 0;
+}
+
+/*
+ * Loads whole bytes until at least 56 bits are buffered or the stream ends.
+ * The fast path may also load the leading bits of the next byte; they are
+ * loaded again, in the same place, by the following refill.
+ */
+static inline void bit_reader_refill(bit_reader_t *br) {
+  if (br->end - br->p >= 8) {
+    br->bits |= load_be64(br->p) >> br->count;
+    br->p += (63 - br->count) >> 3;
+    br->count |= 56;
+  } else {
+    while (br->count <= 56 && br->p < br->end) {
+      br->bits |= (uint64_t) *br->p++ << (56 - br->count);
+      br->count += 8;
+    }
+  }
+}
+
+/*
+ * Decodes one symbol through lookup table entries. An entry that no code
+ * reaches has a length of zero and sets *bad. Reading past the end of the
+ * stream leaves br->count negative.
+ */
+static inline uint8_t bit_reader_decode(const uint16_t *entries,
+                                        bit_reader_t *br, int *bad) {
+  uint16_t e = entries[br->bits >> (64 - HUFFMAN_MAX_BITS)];
+  int len = e >> 8;
+  *bad |= len == 0;
+  br->bits <<= len;
+  br->count -= len;
+  return (uint8_t) e;
+}
+
+#endif
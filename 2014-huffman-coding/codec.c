@@ -0,0 +1,300 @@
+#include <assert.h>
+#include <string.h>
+
+#include "arena.h"
+#include "bitreader.h"
+#include "codec.h"
+
+/*
+ * Adds the number of occurrences of each byte of data to counts.
+ */
+void huffman_histogram(const uint8_t *data, size_t len, uint32_t *counts) {
+  for (size_t i = 0; i < len; i++) {
+    counts[data[i]]++;
+  }
+}
+
+/*
+ * Builds a length-limited canonical Huffman code for the symbol frequencies
+ * in counts. Symbols with a count of zero are given no code.
+ *
+ * Post:  No code is longer than HUFFMAN_MAX_BITS. If a single symbol occurs,
+ *        it is given a one bit code.
+ */
+void huffman_code_build(huffman_code_t *code, const uint32_t *counts) {
+  huffman_arena_t arena;
+  uint32_t scaled[HUFFMAN_SYMBOLS];
+  memcpy(scaled, counts, sizeof(scaled));
+
+  for (;;) {
+    memset(code->lengths, 0, sizeof(code->lengths));
+    huffman_arena_build(&arena, scaled);
+    if (huffman_arena_depths(&arena, code->lengths) <= HUFFMAN_MAX_BITS) {
+      break;
+    }
+
+    // flatten the distribution until the deepest leaf fits
+    for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+      if (scaled[c]) {
+        scaled[c] = (scaled[c] >> 1) | 1;
+      }
+    }
+  }
+
+  huffman_code_assign(code);
+}
+
+/*
+ * Assigns canonical codes to the lengths already present in code. Returns 0
+ * on success or -1 if the lengths do not describe a prefix code.
+ */
+int huffman_code_assign(huffman_code_t *code) {
+  int count[HUFFMAN_MAX_BITS + 1] = { 0 };
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+    if (code->lengths[c] > HUFFMAN_MAX_BITS) {
+      return -1;
+    }
+    count[code->lengths[c]]++;
+  }
+  count[0] = 0;
+
+  // check the Kraft inequality; incomplete codes are allowed
+  int left = 1;
+  for (int len = 1; len <= HUFFMAN_MAX_BITS; len++) {
+    left = (left << 1) - count[len];
+    if (left < 0) {
+      return -1;
+    }
+  }
+
+  uint16_t next[HUFFMAN_MAX_BITS + 1];
+  next[1] = 0;
+  for (int len = 1; len < HUFFMAN_MAX_BITS; len++) {
+    next[len + 1] = (next[len] + count[len]) << 1;
+  }
+
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+    int len = code->lengths[c];
+    code->codes[c] = len ? next[len]++ : 0;
+  }
+  return 0;
+}
+
+/*
+ * Returns the number of bits needed to encode symbols with the given counts
+ * using code.
+ */
+uint64_t huffman_code_cost(const huffman_code_t *code, const uint32_t *counts) {
+  uint64_t bits = 0;
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+    bits += (uint64_t) counts[c] * code->lengths[c];
+  }
+  return bits;
+}
+
+/*
+ * Builds the canonical decoding tables for code.
+ *
+ * Pre: huffman_code_assign succeeded on code.
+ */
+void huffman_decode_table_build(huffman_decode_table_t *table,
+                                const huffman_code_t *code) {
+  uint16_t offset[HUFFMAN_MAX_BITS + 1];
+
+  memset(table->count, 0, sizeof(table->count));
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+    table->count[code->lengths[c]]++;
+  }
+  table->count[0] = 0;
+
+  offset[1] = 0;
+  for (int len = 1; len < HUFFMAN_MAX_BITS; len++) {
+    offset[len + 1] = offset[len] + table->count[len];
+  }
+
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+    if (code->lengths[c]) {
+      table->symbol[offset[code->lengths[c]]++] = c;
+    }
+  }
+}
+
+/*
+ * Builds the single lookup table for code.
+ *
+ * Pre: huffman_code_assign succeeded on code.
+ */
+void huffman_lookup_build(huffman_lookup_t *lookup,
+                          const huffman_code_t *code) {
+  // prefixes that no code starts keep a length of zero
+  memset(lookup->entries, 0, sizeof(lookup->entries));
+
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+    int len = code->lengths[c];
+    if (len == 0) {
+      continue;
+    }
+    int shift = HUFFMAN_MAX_BITS - len;
+    int first = code->codes[c] << shift, last = first + (1 << shift);
+    for (int i = first; i < last; i++) {
+      lookup->entries[i] = (len << 8) | c;
+    }
+  }
+}
+
+/*
+ * Packs the code lengths of code into HUFFMAN_LENGTHS_SIZE bytes of out.
+ */
+void huffman_code_write_lengths(const huffman_code_t *code, uint8_t *out) {
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c += 2) {
+    out[c / 2] = (code->lengths[c] << 4) | code->lengths[c + 1];
+  }
+}
+
+/*
+ * Unpacks HUFFMAN_LENGTHS_SIZE bytes of code lengths from in and assigns
+ * their canonical codes. Returns 0 on success or -1 if the lengths are not a
+ * valid prefix code.
+ */
+int huffman_code_read_lengths(huffman_code_t *code, const uint8_t *in) {
+  for (int c = 0; c < HUFFMAN_SYMBOLS; c += 2) {
+    code->lengths[c] = in[c / 2] >> 4;
+    code->lengths[c + 1] = in[c / 2] & 0xf;
+  }
+  return huffman_code_assign(code);
+}
+
+/*
+ * Starts writing codes to out.
+ */
+void huffman_writer_init(huffman_writer_t *w, uint8_t *out) {
+  w->out = out;
+  w->acc = 0;
+  w->nbits = 0;
+}
+
+/*
+ * Writes the code of symbol c.
+ *
+ * Pre: c has a code.
+ */
+void huffman_write_symbol(huffman_writer_t *w, const huffman_code_t *code,
+                          uint8_t c) {
+  int len = code->lengths[c];
+  assert(len != 0);
+  w->acc = (w->acc << len) | code->codes[c];
+  w->nbits += len;
+  while (w->nbits >= 8) {
+    w->nbits -= 8;
+    *w->out++ = (uint8_t) (w->acc >> w->nbits);
+  }
+}
+
+/*
+ * Writes any bits left over, padding the final byte with zero bits, and
+ * returns the end of the output.
+ */
+uint8_t *huffman_writer_finish(huffman_writer_t *w) {
+  if (w->nbits) {
+    *w->out++ = (uint8_t) (w->acc << (8 - w->nbits));
+    w->nbits = 0;
+  }
+  return w->out;
+}
+
+/*
+ * Decodes one symbol from in, walking the canonical code one bit at a time
+ * from *bit, which is advanced past it. Returns the symbol, or -1 if the
+ * end bit is reached or the code is not in the table.
+ */
+int huffman_decode_symbol(const huffman_decode_table_t *table,
+                          const uint8_t *in, size_t *bit, size_t end) {
+  int code = 0, first = 0, index = 0;
+
+  for (int l = 1; l <= HUFFMAN_MAX_BITS; l++) {
+    if (*bit == end) {
+      return -1;
+    }
+    code |= (in[*bit >> 3] >> (7 - (*bit & 7))) & 1;
+    (*bit)++;
+
+    int count = table->count[l];
+    if (code - count < first) {
+      return table->symbol[index + (code - first)];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+/*
+ * Encodes the n bytes of in with code, most significant bit first, and
+ * returns the number of bytes written to out. The final byte is padded with
+ * zero bits.
+ *
+ * Pre: out has room for HUFFMAN_ENCODED_BOUND(n) bytes and every byte of in
+ *      has a code.
+ */
+size_t huffman_block_encode(const huffman_code_t *code, const uint8_t *in,
+                            size_t n, uint8_t *out) {
+  huffman_writer_t w;
+  huffman_writer_init(&w, out);
+  for (size_t i = 0; i < n; i++) {
+    huffman_write_symbol(&w, code, in[i]);
+  }
+  return huffman_writer_finish(&w) - out;
+}
+
+/*
+ * Decodes n symbols from the len bytes of in into out. Returns 0 on success
+ * or -1 if in runs out or contains a code that is not in the table.
+ */
+int huffman_block_decode(const huffman_decode_table_t *table,
+                         const uint8_t *in, size_t len, uint8_t *out,
+                         size_t n) {
+  size_t bit = 0, end = len * 8;
+
+  for (size_t i = 0; i < n; i++) {
+    int c = huffman_decode_symbol(table, in, &bit, end);
+    if (c < 0) {
+      return -1;
+    }
+    out[i] = (uint8_t) c;
+  }
+  return 0;
+}
+
+/*
+ * Decodes n symbols from the len bytes of in into out with a single table
+ * lookup per symbol. Returns 0 on success or -1 if in runs out or contains a
+ * code that is not in the table.
+ */
+int huffman_block_decode_lookup(const huffman_lookup_t *lookup,
+                                const uint8_t *in, size_t len, uint8_t *out,
+                                size_t n) {
+  bit_reader_t br;
+  int bad = 0;
+  size_t i = 0;
+
+  bit_reader_init(&br, in, len);
+  for (; i + 4 <= n; i += 4) {
+    bit_reader_refill(&br);
+    out[i] = bit_reader_decode(lookup->entries, &br, &bad);
+    out[i + 1] = bit_reader_decode(lookup->entries, &br, &bad);
+    out[i + 2] = bit_reader_decode(lookup->entries, &br, &bad);
+    out[i + 3] = bit_reader_decode(lookup->entries, &br, &bad);
+    if (bad || br.count < 0) {
+      return -1;
+    }
+  }
+  for (; i < n; i++) {
+    bit_reader_refill(&br);
+    out[i] = bit_reader_decode(lookup->entries, &br, &bad);
+    if (bad || br.count < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
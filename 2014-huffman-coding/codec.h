@@ -0,0 +1,89 @@
+#ifndef __CODEC_H
+#define __CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Byte-oriented canonical Huffman codes, shared by the block and stream
+ * coders. Unlike the string API in exam.h, every byte value (including '\0')
+ * is a valid symbol.
+ */
+
+enum { HUFFMAN_SYMBOLS = 256 };
+
+/*
+ * Codes are limited to HUFFMAN_MAX_BITS so that a code length fits in a
+ * nibble of a block header.
+ */
+enum { HUFFMAN_MAX_BITS = 12 };
+
+typedef struct huffman_code {
+  uint8_t lengths[HUFFMAN_SYMBOLS];
+  uint16_t codes[HUFFMAN_SYMBOLS];
+} huffman_code_t;
+
+/*
+ * Canonical decoding tables: the number of codes of each length, and the
+ * symbols ordered by code.
+ */
+typedef struct huffman_decode_table {
+  uint16_t count[HUFFMAN_MAX_BITS + 1];
+  uint16_t symbol[HUFFMAN_SYMBOLS];
+} huffman_decode_table_t;
+
+/*
+ * Single lookup table decoding: every HUFFMAN_MAX_BITS bit prefix maps to the
+ * symbol whose code it starts with, in the low byte, and the length of that
+ * code, in the high byte.
+ */
+typedef struct huffman_lookup {
+  uint16_t entries[1 << HUFFMAN_MAX_BITS];
+} huffman_lookup_t;
+
+/*
+ * A block of at most HUFFMAN_BLOCK_SIZE symbols is coded with one table.
+ * Code lengths are stored as nibbles, two per byte.
+ */
+enum { HUFFMAN_BLOCK_SIZE = 1 << 16 };
+enum { HUFFMAN_LENGTHS_SIZE = HUFFMAN_SYMBOLS / 2 };
+
+/*
+ * A most-significant-bit-first writer of codes, shared by the block and
+ * stream encoders. acc holds the nbits bits not yet written to out.
+ */
+typedef struct huffman_writer {
+  uint8_t *out;
+  uint64_t acc;
+  int nbits;
+} huffman_writer_t;
+
+/*
+ * An upper bound on the encoded size of n symbols.
+ */
+#define HUFFMAN_ENCODED_BOUND(n) (((size_t) (n) * HUFFMAN_MAX_BITS + 7) / 8)
+
+void huffman_histogram(const uint8_t *, size_t, uint32_t *);
+void huffman_code_build(huffman_code_t *, const uint32_t *);
+int huffman_code_assign(huffman_code_t *);
+uint64_t huffman_code_cost(const huffman_code_t *, const uint32_t *);
+void huffman_code_write_lengths(const huffman_code_t *, uint8_t *);
+int huffman_code_read_lengths(huffman_code_t *, const uint8_t *);
+void huffman_decode_table_build(huffman_decode_table_t *,
+                                const huffman_code_t *);
+void huffman_lookup_build(huffman_lookup_t *, const huffman_code_t *);
+
+void huffman_writer_init(huffman_writer_t *, uint8_t *);
+void huffman_write_symbol(huffman_writer_t *, const huffman_code_t *, uint8_t);
+uint8_t *huffman_writer_finish(huffman_writer_t *);
+int huffman_decode_symbol(const huffman_decode_table_t *, const uint8_t *,
+                          size_t *, size_t);
+
+size_t huffman_block_encode(const huffman_code_t *, const uint8_t *, size_t,
+                            uint8_t *);
+int huffman_block_decode(const huffman_decode_table_t *, const uint8_t *,
+                         size_t, uint8_t *, size_t);
+int huffman_block_decode_lookup(const huffman_lookup_t *, const uint8_t *,
+                                size_t, uint8_t *, size_t);
+
+#endif
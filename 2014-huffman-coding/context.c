@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitreader.h"
+#include "context.h"
+
+enum { BITMAP_SIZE = HUFFMAN_SYMBOLS / 8 };
+enum { LENGTH_CODE_SIZE = (ORDER1_LENGTH_SYMBOLS + 1) / 2 };
+enum { TABLES_HEADER_SIZE = BITMAP_SIZE + LENGTH_CODE_SIZE + 4 };
+
+/*
+ * Allocates the (large) per-context state.
+ */
+huffman_order1_t *huffman_order1_alloc(void) {
+  huffman_order1_t *m = malloc(sizeof(huffman_order1_t));
+  if (m == NULL) {
+    perror("huffman_order1_alloc");
+    exit(EXIT_FAILURE);
+  }
+  memset(m->empty.entries, 0, sizeof(m->empty.entries));
+  return m;
+}
+
+void huffman_order1_free(huffman_order1_t *m) {
+  free(m);
+}
+
+/*
+ * Counts the symbols of in by context, replacing any earlier counts.
+ */
+void huffman_order1_count(huffman_order1_t *m, const uint8_t *in, size_t n) {
+  memset(m->used, 0, sizeof(m->used));
+  memset(m->counts, 0, sizeof(m->counts));
+
+  uint8_t prev = 0;
+  for (size_t i = 0; i < n; i++) {
+    m->counts[prev][in[i]]++;
+    m->used[prev] = 1;
+    prev = in[i];
+  }
+}
+
+/*
+ * Builds a table for every context present in the counts, and the shared
+ * code for their lengths. Returns the number of bytes huffman_order1_encode
+ * will write.
+ */
+size_t huffman_order1_build(huffman_order1_t *m) {
+  memset(m->length_counts, 0, sizeof(m->length_counts));
+  m->nlengths = 0;
+  m->payload_bits = 0;
+
+  for (int ctx = 0; ctx < HUFFMAN_SYMBOLS; ctx++) {
+    if (!m->used[ctx]) {
+      continue;
+    }
+    huffman_code_build(&m->codes[ctx], m->counts[ctx]);
+    m->payload_bits += huffman_code_cost(&m->codes[ctx], m->counts[ctx]);
+
+    for (int c = 0; c < HUFFMAN_SYMBOLS; c++) {
+      uint8_t len = m->codes[ctx].lengths[c];
+      m->lengths[m->nlengths++] = len;
+      m->length_counts[len]++;
+    }
+  }
+
+  huffman_code_build(&m->length_code, m->length_counts);
+  size_t tables = (huffman_code_cost(&m->length_code, m->length_counts) + 7)
+                  / 8;
+  return TABLES_HEADER_SIZE + tables + (m->payload_bits + 7) / 8;
+}
+
+/*
+ * Writes the context tables built by huffman_order1_build, followed by the n
+ * bytes of in coded by context, and returns the number of bytes written.
+ *
+ * Pre: m was built from the counts of in, and out has room for the size
+ *      huffman_order1_build returned.
+ */
+size_t huffman_order1_encode(const huffman_order1_t *m, const uint8_t *in,
+                             size_t n, uint8_t *out) {
+  uint8_t *start = out;
+
+  memset(out, 0, BITMAP_SIZE + LENGTH_CODE_SIZE);
+  for (int ctx = 0; ctx < HUFFMAN_SYMBOLS; ctx++) {
+    if (m->used[ctx]) {
+      out[ctx / 8] |= 1 << (ctx % 8);
+    }
+  }
+  out += BITMAP_SIZE;
+
+  for (int i = 0; i < ORDER1_LENGTH_SYMBOLS; i++) {
+    out[i / 2] |= m->length_code.lengths[i] << (i % 2 ? 0 : 4);
+  }
+  out += LENGTH_CODE_SIZE;
+
+  size_t tables = huffman_block_encode(&m->length_code, m->lengths,
+                                       m->nlengths, out + 4);
+  out[0] = tables;
+  out[1] = tables >> 8;
+  out[2] = tables >> 16;
+  out[3] = tables >> 24;
+  out += 4 + tables;
+
+  huffman_writer_t w;
+  uint8_t prev = 0;
+
+  huffman_writer_init(&w, out);
+  for (size_t i = 0; i < n; i++) {
+    huffman_write_symbol(&w, &m->codes[prev], in[i]);
+    prev = in[i];
+  }
+  return huffman_writer_finish(&w) - start;
+}
+
+/*
+ * Reads the context tables from the len bytes of in, then decodes n symbols
+ * from the payload that follows them into out. Returns 0 on success or -1 if
+ * the tables or payload are invalid.
+ */
+int huffman_order1_decode(huffman_order1_t *m, const uint8_t *in, size_t len,
+                          uint8_t *out, size_t n) {
+  if (len < TABLES_HEADER_SIZE) {
+    return -1;
+  }
+
+  m->nlengths = 0;
+  for (int ctx = 0; ctx < HUFFMAN_SYMBOLS; ctx++) {
+    m->used[ctx] = (in[ctx / 8] >> (ctx % 8)) & 1;
+    m->nlengths += m->used[ctx] ? HUFFMAN_SYMBOLS : 0;
+  }
+  in += BITMAP_SIZE;
+
+  memset(m->length_code.lengths, 0, sizeof(m->length_code.lengths));
+  for (int i = 0; i < ORDER1_LENGTH_SYMBOLS; i++) {
+    m->length_code.lengths[i] = (in[i / 2] >> (i % 2 ? 0 : 4)) & 0xf;
+  }
+  if (huffman_code_assign(&m->length_code)) {
+    return -1;
+  }
+  in += LENGTH_CODE_SIZE;
+
+  size_t tables = in[0] | (in[1] << 8) | (in[2] << 16) |
+                  ((size_t) in[3] << 24);
+  in += 4;
+  len -= TABLES_HEADER_SIZE;
+  if (tables > len) {
+    return -1;
+  }
+
+  huffman_decode_table_t length_table;
+  huffman_decode_table_build(&length_table, &m->length_code);
+  if (huffman_block_decode(&length_table, in, tables, m->lengths,
+                           m->nlengths)) {
+    return -1;
+  }
+  in += tables;
+  len -= tables;
+
+  const uint8_t *lengths = m->lengths;
+  for (int ctx = 0; ctx < HUFFMAN_SYMBOLS; ctx++) {
+    m->context_lookup[ctx] = &m->empty;
+    if (!m->used[ctx]) {
+      continue;
+    }
+    memcpy(m->codes[ctx].lengths, lengths, HUFFMAN_SYMBOLS);
+    lengths += HUFFMAN_SYMBOLS;
+    if (huffman_code_assign(&m->codes[ctx])) {
+      return -1;
+    }
+    huffman_lookup_build(&m->lookups[ctx], &m->codes[ctx]);
+    m->context_lookup[ctx] = &m->lookups[ctx];
+  }
+
+  // each symbol selects the next table, so the lookups are serial, but one
+  // refill still covers four of them
+  bit_reader_t br;
+  int bad = 0;
+  size_t i = 0;
+  uint8_t prev = 0;
+
+  bit_reader_init(&br, in, len);
+  for (; i + 4 <= n; i += 4) {
+    bit_reader_refill(&br);
+    prev = out[i] = bit_reader_decode(m->context_lookup[prev]->entries, &br,
+                                      &bad);
+    prev = out[i + 1] = bit_reader_decode(m->context_lookup[prev]->entries,
+                                          &br, &bad);
+    prev = out[i + 2] = bit_reader_decode(m->context_lookup[prev]->entries,
+                                          &br, &bad);
+    prev = out[i + 3] = bit_reader_decode(m->context_lookup[prev]->entries,
+                                          &br, &bad);
+    if (bad || br.count < 0) {
+      return -1;
+    }
+  }
+  for (; i < n; i++) {
+    bit_reader_refill(&br);
+    prev = out[i] = bit_reader_decode(m->context_lookup[prev]->entries, &br,
+                                      &bad);
+    if (bad || br.count < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef __CONTEXT_H
+#define __CONTEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codec.h"
+
+/*
+ * Order-1 context modelling: every symbol is coded with a table selected by
+ * the symbol before it, so structured input that repeats the same byte pairs
+ * codes more tightly than with a single order-0 table. The first symbol of a
+ * block uses context 0.
+ *
+ * Only the contexts that occur in a block get a table. All their code lengths
+ * are sent together, themselves Huffman coded with one shared code over the
+ * length values:
+ *
+ * The decoder builds a single lookup table for each context present; the
+ * others share an empty table, so a stream that reaches one is refused.
+ *
+ *   32 bytes   bitmap of the contexts present
+ *    7 bytes   packed code lengths of the shared length code
+ *    4 bytes   size of the coded lengths
+ *              coded lengths, 256 per context present
+ *              payload
+ */
+
+enum { ORDER1_LENGTH_SYMBOLS = HUFFMAN_MAX_BITS + 1 };
+
+typedef struct huffman_order1 {
+  uint8_t used[HUFFMAN_SYMBOLS];
+  uint32_t counts[HUFFMAN_SYMBOLS][HUFFMAN_SYMBOLS];
+  huffman_code_t codes[HUFFMAN_SYMBOLS];
+  huffman_lookup_t lookups[HUFFMAN_SYMBOLS];
+  huffman_lookup_t empty;
+  const huffman_lookup_t *context_lookup[HUFFMAN_SYMBOLS];
+  huffman_code_t length_code;
+  uint32_t length_counts[HUFFMAN_SYMBOLS];
+  size_t nlengths;
+  uint8_t lengths[HUFFMAN_SYMBOLS * HUFFMAN_SYMBOLS];
+  uint64_t payload_bits;
+} huffman_order1_t;
+
+huffman_order1_t *huffman_order1_alloc(void);
+void huffman_order1_free(huffman_order1_t *);
+
+void huffman_order1_count(huffman_order1_t *, const uint8_t *, size_t);
+size_t huffman_order1_build(huffman_order1_t *);
+size_t huffman_order1_encode(const huffman_order1_t *, const uint8_t *,
+                             size_t, uint8_t *);
+int huffman_order1_decode(huffman_order1_t *, const uint8_t *, size_t,
+                          uint8_t *, size_t);
+
+#endif
@@ -0,0 +1,102 @@
+#include <assert.h>
+
+#include "bitreader.h"
+#include "interleave.h"
+
+/*
+ * Encodes every fourth byte of the n bytes of in, starting at in[first], and
+ * returns the number of bytes written to out.
+ */
+static size_t encode_stream(const huffman_code_t *code, const uint8_t *in,
+                            size_t n, size_t first, uint8_t *out) {
+  huffman_writer_t w;
+  huffman_writer_init(&w, out);
+  for (size_t i = first; i < n; i += INTERLEAVE_STREAMS) {
+    huffman_write_symbol(&w, code, in[i]);
+  }
+  return huffman_writer_finish(&w) - out;
+}
+
+/*
+ * Encodes the n bytes of in with code into four interleaved streams and
+ * returns the number of bytes written to out, including the stream sizes.
+ *
+ * Pre: out has room for INTERLEAVE_HEADER_SIZE + HUFFMAN_ENCODED_BOUND(n) +
+ *      INTERLEAVE_STREAMS bytes and every byte of in has a code.
+ */
+size_t huffman_block_encode4(const huffman_code_t *code, const uint8_t *in,
+                             size_t n, uint8_t *out) {
+  uint8_t *p = out + INTERLEAVE_HEADER_SIZE;
+
+  for (int s = 0; s < INTERLEAVE_STREAMS; s++) {
+    size_t len = encode_stream(code, in, n, s, p);
+    if (s < INTERLEAVE_STREAMS - 1) {
+      out[4 * s] = len;
+      out[4 * s + 1] = len >> 8;
+      out[4 * s + 2] = len >> 16;
+      out[4 * s + 3] = len >> 24;
+    }
+    p += len;
+  }
+  return p - out;
+}
+
+/*
+ * Decodes n symbols from the four interleaved streams in the len bytes of in
+ * into out. Returns 0 on success or -1 if a stream runs out or contains a
+ * code that is not in the table.
+ */
+int huffman_block_decode4(const huffman_lookup_t *lookup, const uint8_t *in,
+                          size_t len, uint8_t *out, size_t n) {
+  const uint16_t *entries = lookup->entries;
+  bit_reader_t br[INTERLEAVE_STREAMS];
+  int bad = 0;
+
+  if (len < INTERLEAVE_HEADER_SIZE) {
+    return -1;
+  }
+  const uint8_t *p = in + INTERLEAVE_HEADER_SIZE;
+  size_t left = len - INTERLEAVE_HEADER_SIZE;
+  for (int s = 0; s < INTERLEAVE_STREAMS; s++) {
+    size_t size = left;
+    if (s < INTERLEAVE_STREAMS - 1) {
+      size = in[4 * s] | (in[4 * s + 1] << 8) | (in[4 * s + 2] << 16) |
+             ((size_t) in[4 * s + 3] << 24);
+      if (size > left) {
+        return -1;
+      }
+    }
+    bit_reader_init(&br[s], p, size);
+    p += size;
+    left -= size;
+  }
+
+  // Each refill leaves room for four symbols per stream, so sixteen symbols
+  // are decoded per pass with the four streams' work independent.
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    bit_reader_refill(&br[0]);
+    bit_reader_refill(&br[1]);
+    bit_reader_refill(&br[2]);
+    bit_reader_refill(&br[3]);
+    for (int k = 0; k < 16; k += 4) {
+      out[i + k] = bit_reader_decode(entries, &br[0], &bad);
+      out[i + k + 1] = bit_reader_decode(entries, &br[1], &bad);
+      out[i + k + 2] = bit_reader_decode(entries, &br[2], &bad);
+      out[i + k + 3] = bit_reader_decode(entries, &br[3], &bad);
+    }
+    if (bad || (br[0].count | br[1].count | br[2].count | br[3].count) < 0) {
+      return -1;
+    }
+  }
+
+  for (; i < n; i++) {
+    bit_reader_t *r = &br[i % INTERLEAVE_STREAMS];
+    bit_reader_refill(r);
+    out[i] = bit_reader_decode(entries, r, &bad);
+    if (bad || r->count < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef __INTERLEAVE_H
+#define __INTERLEAVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codec.h"
+
+/*
+ * Four-way interleaved block coding. Symbol i of a block goes to stream
+ * i % 4, so the decoder can work on four independent bit streams at once
+ * instead of waiting for each code length before it can read the next code.
+ *
+ * The payload starts with the little-endian 32 bit sizes of the first three
+ * streams; the fourth takes the rest.
+ */
+
+enum { INTERLEAVE_STREAMS = 4 };
+enum { INTERLEAVE_HEADER_SIZE = 4 * (INTERLEAVE_STREAMS - 1) };
+
+size_t huffman_block_encode4(const huffman_code_t *, const uint8_t *, size_t,
+                             uint8_t *);
+int huffman_block_decode4(const huffman_lookup_t *, const uint8_t *, size_t,
+                          uint8_t *, size_t);
+
+#endif
@@ -5,8 +5,174 @@
 
 #include "exam.h"
 #include "map.h"
+#include "mapio.h"
+#include "stream.h"
+
+enum { CHUNK_SIZE = 1 << 16 };
+
+/*
+ * Output callback for the stream coders; writes to the FILE * in ctx.
+ */
+static void write_output(void *ctx, const uint8_t *data, size_t len) {
+  if (fwrite(data, 1, len, ctx) != len) {
+    perror("fwrite");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*
+ * Compresses stdin to stdout a chunk at a time.
+ */
+static int compress_stream(huffman_mode_t mode) {
+  static uint8_t chunk[CHUNK_SIZE];
+  huffman_encoder_t *enc = huffman_encoder_init(mode, write_output, stdout);
+  size_t n;
+
+  while ((n = fread(chunk, 1, CHUNK_SIZE, stdin)) > 0) {
+    huffman_encoder_feed(enc, chunk, n);
+  }
+  huffman_encoder_finish(enc);
+  return ferror(stdin) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Decompresses stdin to stdout a chunk at a time.
+ */
+static int decompress_stream(void) {
+  static uint8_t chunk[CHUNK_SIZE];
+  huffman_decoder_t *dec = huffman_decoder_init(write_output, stdout);
+  huffman_error_t err = HUFFMAN_OK;
+  size_t n;
+
+  while (!err && (n = fread(chunk, 1, CHUNK_SIZE, stdin)) > 0) {
+    err = huffman_decoder_feed(dec, chunk, n);
+  }
+  err = huffman_decoder_finish(dec);
+  if (err) {
+    huffman_print_error(err);
+    return EXIT_FAILURE;
+  }
+  return ferror(stdin) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Compresses the file at in_path to out_path ("-" for stdout). A regular
+ * input file is memory-mapped and coded in place, so there is no limit on
+ * its size and no read buffer; anything else is read a chunk at a time.
+ */
+static int compress_file(huffman_mode_t mode, const char *in_path,
+                         const char *out_path) {
+  static uint8_t chunk[CHUNK_SIZE];
+  mapped_file_t in;
+  file_writer_t out;
+  if (mapped_file_open(&in, in_path)) {
+    return EXIT_FAILURE;
+  }
+  if (file_writer_open(&out, out_path)) {
+    mapped_file_close(&in);
+    return EXIT_FAILURE;
+  }
+
+  huffman_encoder_t *enc = huffman_encoder_init(mode, file_writer_output,
+                                                &out);
+  long n = 0;
+  if (in.fd < 0) {
+    huffman_encoder_feed(enc, in.data, in.len);
+  } else {
+    while ((n = mapped_file_read(&in, chunk, CHUNK_SIZE)) > 0) {
+      huffman_encoder_feed(enc, chunk, n);
+    }
+  }
+  huffman_encoder_finish(enc);
+
+  mapped_file_close(&in);
+  if (file_writer_close(&out)) {
+    return EXIT_FAILURE;
+  }
+  return n < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Decompresses the file at in_path to out_path ("-" for stdout), decoding
+ * the memory-mapped stream in place, or a chunk at a time if it is not a
+ * regular file.
+ */
+static int decompress_file(const char *in_path, const char *out_path) {
+  static uint8_t chunk[CHUNK_SIZE];
+  mapped_file_t in;
+  file_writer_t out;
+  if (mapped_file_open(&in, in_path)) {
+    return EXIT_FAILURE;
+  }
+  if (file_writer_open(&out, out_path)) {
+    mapped_file_close(&in);
+    return EXIT_FAILURE;
+  }
+
+  huffman_decoder_t *dec = huffman_decoder_init(file_writer_output, &out);
+  huffman_error_t err = HUFFMAN_OK;
+  long n = 0;
+  if (in.fd < 0) {
+    err = huffman_decoder_feed(dec, in.data, in.len);
+  } else {
+    while (!err && (n = mapped_file_read(&in, chunk, CHUNK_SIZE)) > 0) {
+      err = huffman_decoder_feed(dec, chunk, n);
+    }
+  }
+  err = huffman_decoder_finish(dec);
+
+  mapped_file_close(&in);
+  if (file_writer_close(&out) || n < 0) {
+    return EXIT_FAILURE;
+  }
+  if (err) {
+    huffman_print_error(err);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Compresses in_path, or stdin if it is NULL, to out_path.
+ */
+static int compress(huffman_mode_t mode, const char *in_path,
+                    const char *out_path) {
+  if (in_path == NULL) {
+    return compress_stream(mode);
+  }
+  return compress_file(mode, in_path, out_path);
+}
 
 int main(int argc, char **argv) {
+  // flag [input [output]]; without an input the tool filters stdin to stdout
+  if (argc >= 2 && argc <= 4) {
+    const char *in_path = argc > 2 ? argv[2] : NULL;
+    const char *out_path = argc > 3 ? argv[3] : "-";
+
+    if (strcmp(argv[1], "-c") == 0) {
+      return compress(HUFFMAN_STATIC, in_path, out_path);
+    }
+    if (strcmp(argv[1], "-a") == 0) {
+      return compress(HUFFMAN_ADAPTIVE, in_path, out_path);
+    }
+    if (strcmp(argv[1], "-o") == 0) {
+      return compress(HUFFMAN_ORDER1, in_path, out_path);
+    }
+    if (strcmp(argv[1], "-i") == 0) {
+      return compress(HUFFMAN_INTERLEAVED, in_path, out_path);
+    }
+    if (strcmp(argv[1], "-d") == 0) {
+      return in_path ? decompress_file(in_path, out_path)
+                     : decompress_stream();
+    }
+    // files were named, so this is not a string for the exam functions
+    if (argc > 2) {
+      fprintf(stderr, "Usage: %s -c|-a|-o|-i|-d [input [output]]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
   char s[MAX_STRING_LENGTH];
 
   printf("Please enter a string for processing: ");
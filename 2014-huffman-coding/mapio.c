@@ -0,0 +1,156 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapio.h"
+
+/*
+ * Maps the file at path read-only into f. An empty file has no mapping and
+ * leaves f->data NULL. Anything but a regular file reports a size of 0
+ * whatever it holds, so it is not mapped but left open in f->fd, to be read
+ * with mapped_file_read; otherwise f->fd is -1. Returns 0 on success or -1,
+ * having printed the cause, on failure.
+ */
+int mapped_file_open(mapped_file_t *f, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+
+  f->data = NULL;
+  f->len = 0;
+  f->fd = -1;
+  if (!S_ISREG(st.st_mode)) {
+    f->fd = fd;
+    return 0;
+  }
+
+  f->len = st.st_size;
+  if (f->len > 0) {
+    void *p = mmap(NULL, f->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      perror(path);
+      close(fd);
+      return -1;
+    }
+    // the coders make one front-to-back pass per block
+    posix_madvise(p, f->len, POSIX_MADV_SEQUENTIAL);
+    f->data = p;
+  }
+  close(fd);
+  return 0;
+}
+
+/*
+ * Reads up to len bytes of the unmapped file f into buffer, retrying reads
+ * that are interrupted. Returns the number read, 0 at the end of the file,
+ * or -1, having printed the cause, on failure.
+ */
+long mapped_file_read(mapped_file_t *f, uint8_t *buffer, size_t len) {
+  ssize_t n;
+  do {
+    n = read(f->fd, buffer, len);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    perror("read");
+  }
+  return n;
+}
+
+void mapped_file_close(mapped_file_t *f) {
+  if (f->data != NULL) {
+    munmap((void *) f->data, f->len);
+  }
+  if (f->fd >= 0) {
+    close(f->fd);
+  }
+}
+
+/*
+ * Writes all len bytes of data to fd, retrying short writes.
+ */
+static void write_all(int fd, const uint8_t *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0) {
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+/*
+ * Opens w for writing to the file at path, truncating it, or to stdout if
+ * path is "-". Returns 0 on success or -1, having printed the cause, on
+ * failure.
+ */
+int file_writer_open(file_writer_t *w, const char *path) {
+  if (strcmp(path, "-") == 0) {
+    w->fd = STDOUT_FILENO;
+  } else {
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (w->fd < 0) {
+      perror(path);
+      return -1;
+    }
+  }
+
+  void *buffer;
+  if (posix_memalign(&buffer, 4096, WRITER_BUFFER_SIZE)) {
+    perror("file_writer_open");
+    exit(EXIT_FAILURE);
+  }
+  w->buffer = buffer;
+  w->len = 0;
+  return 0;
+}
+
+/*
+ * Output callback for the stream coders; appends to the file_writer_t in
+ * ctx. A chunk that does not fit in what is left of the buffer flushes it,
+ * and one at least as large as the whole buffer is written directly.
+ */
+void file_writer_output(void *ctx, const uint8_t *data, size_t len) {
+  file_writer_t *w = ctx;
+  if (w->len + len > WRITER_BUFFER_SIZE) {
+    write_all(w->fd, w->buffer, w->len);
+    w->len = 0;
+  }
+  if (len >= WRITER_BUFFER_SIZE) {
+    write_all(w->fd, data, len);
+    return;
+  }
+  memcpy(w->buffer + w->len, data, len);
+  w->len += len;
+}
+
+/*
+ * Flushes and closes w. Returns 0 on success or -1 if the file could not be
+ * closed.
+ */
+int file_writer_close(file_writer_t *w) {
+  write_all(w->fd, w->buffer, w->len);
+  free(w->buffer);
+  if (w->fd != STDOUT_FILENO && close(w->fd) < 0) {
+    perror("close");
+    return -1;
+  }
+  return 0;
+}
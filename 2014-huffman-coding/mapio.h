@@ -0,0 +1,39 @@
+#ifndef __MAPIO_H
+#define __MAPIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * File input and output for the command line tool that bypasses stdio. An
+ * input file is mapped read-only so that the coders read its pages in place,
+ * unless it is not a regular file (a pipe or a device, say), whose size is
+ * not known up front: that is left open as fd and read in chunks instead;
+ * output is gathered in a large page-aligned buffer and handed to write(2) in
+ * big chunks, or written straight from the caller's memory when a chunk is
+ * larger than the buffer.
+ */
+
+enum { WRITER_BUFFER_SIZE = 1 << 20 };
+
+typedef struct mapped_file {
+  const uint8_t *data;
+  size_t len;
+  int fd;
+} mapped_file_t;
+
+typedef struct file_writer {
+  int fd;
+  size_t len;
+  uint8_t *buffer;
+} file_writer_t;
+
+int mapped_file_open(mapped_file_t *, const char *);
+long mapped_file_read(mapped_file_t *, uint8_t *, size_t);
+void mapped_file_close(mapped_file_t *);
+
+int file_writer_open(file_writer_t *, const char *);
+void file_writer_output(void *, const uint8_t *, size_t);
+int file_writer_close(file_writer_t *);
+
+#endif
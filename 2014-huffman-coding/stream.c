@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adaptive.h"
+#include "codec.h"
+#include "context.h"
+#include "interleave.h"
+#include "stream.h"
+
+enum {
+  BLOCK_END,
+  BLOCK_STORED,
+  BLOCK_HUFFMAN,
+  BLOCK_ADAPTIVE,
+  BLOCK_ORDER1,
+  BLOCK_HUFFMAN4
+};
+
+/*
+ * Sizes of the stream magic, the common block header, the extra header of a
+ * Huffman block and the payload size field of the other block types.
+ */
+enum { MAGIC_SIZE = 4 };
+enum { BLOCK_HEADER_SIZE = 1 + 4 };
+enum { HUFFMAN_HEADER_SIZE = 4 + HUFFMAN_LENGTHS_SIZE };
+enum { PAYLOAD_HEADER_SIZE = 4 };
+
+enum {
+  PAYLOAD_SIZE = HUFFMAN_ENCODED_BOUND(HUFFMAN_BLOCK_SIZE) +
+                 INTERLEAVE_HEADER_SIZE + INTERLEAVE_STREAMS
+};
+
+struct huffman_encoder {
+  huffman_output_fn output;
+  void *ctx;
+  huffman_mode_t mode;
+  huffman_model_t model;
+  huffman_order1_t *order1;
+  size_t len;
+  uint8_t block[HUFFMAN_BLOCK_SIZE];
+  uint8_t out[BLOCK_HEADER_SIZE + HUFFMAN_HEADER_SIZE + PAYLOAD_SIZE];
+};
+
+typedef enum {
+  READ_MAGIC,
+  READ_BLOCK_HEADER,
+  READ_HUFFMAN_HEADER,
+  READ_PAYLOAD_HEADER,
+  READ_STORED,
+  READ_PAYLOAD,
+  STREAM_DONE
+} decoder_state_t;
+
+struct huffman_decoder {
+  huffman_output_fn output;
+  void *ctx;
+  huffman_error_t error;
+
+  // bytes of the current field still being gathered into target; field
+  // points at the complete field, in target or in place in the caller's input
+  decoder_state_t state;
+  uint8_t *target;
+  const uint8_t *field;
+  size_t have, need;
+
+  huffman_mode_t mode;
+  huffman_model_t model;
+  huffman_order1_t *order1;
+  uint8_t type;
+  uint32_t raw_len;
+  huffman_code_t code;
+  huffman_lookup_t lookup;
+  uint8_t header[HUFFMAN_HEADER_SIZE];
+  uint8_t payload[PAYLOAD_SIZE];
+  uint8_t block[HUFFMAN_BLOCK_SIZE];
+};
+
+/*
+ * A table of error messages relating to the error codes defined in
+ * huffman_error_t.
+ */
+static const char *huffman_error_table[] =
+  { "",
+    "Error: input is not a Huffman stream.",
+    "Error: Huffman stream is corrupt.",
+    "Error: Huffman stream ends unexpectedly."
+  };
+
+/*
+ * Prints an error message that corresponds to the supplied error code.
+ */
+void huffman_print_error(huffman_error_t error) {
+  fprintf(stderr, "%s\n", huffman_error_table[error]);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/*
+ * Allocates an encoder for the given mode that passes its output to the
+ * given callback, and emits the stream header.
+ */
+huffman_encoder_t *huffman_encoder_init(huffman_mode_t mode,
+                                        huffman_output_fn output, void *ctx) {
+  huffman_encoder_t *enc = malloc(sizeof(huffman_encoder_t));
+  if (enc == NULL) {
+    perror("huffman_encoder_init");
+    exit(EXIT_FAILURE);
+  }
+  enc->output = output;
+  enc->ctx = ctx;
+  enc->mode = mode;
+  enc->len = 0;
+  enc->order1 = mode == HUFFMAN_ORDER1 ? huffman_order1_alloc() : NULL;
+  if (mode == HUFFMAN_ADAPTIVE) {
+    huffman_model_init(&enc->model);
+  }
+
+  const uint8_t magic[MAGIC_SIZE] = { 'H', 'U', 'F', mode };
+  output(ctx, magic, MAGIC_SIZE);
+  return enc;
+}
+
+/*
+ * Encodes and emits the len bytes of block with the adaptive model. The block
+ * is never stored raw, as the decoder has to see every symbol to keep its
+ * model in step.
+ */
+static void encode_adaptive_block(huffman_encoder_t *enc,
+                                  const uint8_t *block, size_t len) {
+  uint8_t *p = enc->out;
+  p[0] = BLOCK_ADAPTIVE;
+  put_le32(p + 1, len);
+  p += BLOCK_HEADER_SIZE + PAYLOAD_HEADER_SIZE;
+
+  size_t payload_len = huffman_adaptive_encode(&enc->model, block, len, p);
+  put_le32(enc->out + BLOCK_HEADER_SIZE, payload_len);
+  enc->output(enc->ctx, enc->out, (p + payload_len) - enc->out);
+}
+
+/*
+ * Encodes and emits the len bytes of block with a table per context if that
+ * is smaller than order0_len, the size of the order-0 coding. Returns 1 if
+ * the block was emitted.
+ */
+static int encode_order1_block(huffman_encoder_t *enc, const uint8_t *block,
+                               size_t len, size_t order0_len) {
+  huffman_order1_count(enc->order1, block, len);
+  size_t payload_len = huffman_order1_build(enc->order1);
+  if (PAYLOAD_HEADER_SIZE + payload_len >= order0_len) {
+    return 0;
+  }
+
+  uint8_t *p = enc->out;
+  p[0] = BLOCK_ORDER1;
+  put_le32(p + 1, len);
+  p += BLOCK_HEADER_SIZE;
+  put_le32(p, payload_len);
+  p += PAYLOAD_HEADER_SIZE;
+  p += huffman_order1_encode(enc->order1, block, len, p);
+  enc->output(enc->ctx, enc->out, p - enc->out);
+  return 1;
+}
+
+/*
+ * Encodes and emits the len bytes of block, which may be the encoder's own
+ * buffer or the caller's memory. In the static modes the block is stored raw
+ * if Huffman coding would not make it smaller.
+ */
+static void encode_block(huffman_encoder_t *enc, const uint8_t *block,
+                         size_t len) {
+  if (len == 0) {
+    return;
+  }
+  if (enc->mode == HUFFMAN_ADAPTIVE) {
+    encode_adaptive_block(enc, block, len);
+    return;
+  }
+
+  uint32_t counts[HUFFMAN_SYMBOLS] = { 0 };
+  huffman_code_t code;
+  huffman_histogram(block, len, counts);
+  huffman_code_build(&code, counts);
+
+  // an upper bound on the payload; interleaving pads every stream
+  size_t payload_len = (huffman_code_cost(&code, counts) + 7) / 8;
+  if (enc->mode == HUFFMAN_INTERLEAVED) {
+    payload_len += INTERLEAVE_HEADER_SIZE + INTERLEAVE_STREAMS;
+  }
+  size_t order0_len = HUFFMAN_HEADER_SIZE + payload_len;
+  if (order0_len > len) {
+    order0_len = len;
+  }
+
+  if (enc->order1 && encode_order1_block(enc, block, len, order0_len)) {
+    return;
+  }
+
+  put_le32(enc->out + 1, len);
+  if (HUFFMAN_HEADER_SIZE + payload_len >= len) {
+    enc->out[0] = BLOCK_STORED;
+    enc->output(enc->ctx, enc->out, BLOCK_HEADER_SIZE);
+    enc->output(enc->ctx, block, len);
+  } else {
+    uint8_t *p = enc->out + BLOCK_HEADER_SIZE;
+    huffman_code_write_lengths(&code, p + 4);
+    if (enc->mode == HUFFMAN_INTERLEAVED) {
+      enc->out[0] = BLOCK_HUFFMAN4;
+      payload_len = huffman_block_encode4(&code, block, len,
+                                          p + HUFFMAN_HEADER_SIZE);
+    } else {
+      enc->out[0] = BLOCK_HUFFMAN;
+      payload_len = huffman_block_encode(&code, block, len,
+                                         p + HUFFMAN_HEADER_SIZE);
+    }
+    put_le32(p, payload_len);
+    p += HUFFMAN_HEADER_SIZE + payload_len;
+    enc->output(enc->ctx, enc->out, p - enc->out);
+  }
+}
+
+/*
+ * Feeds len bytes of data to the encoder. Output is emitted each time a block
+ * fills up. Whole blocks are coded straight from data when nothing is
+ * buffered, so a large or memory-mapped input is never copied.
+ */
+void huffman_encoder_feed(huffman_encoder_t *enc, const uint8_t *data,
+                          size_t len) {
+  while (len > 0) {
+    if (enc->len == 0 && len >= HUFFMAN_BLOCK_SIZE) {
+      encode_block(enc, data, HUFFMAN_BLOCK_SIZE);
+      data += HUFFMAN_BLOCK_SIZE;
+      len -= HUFFMAN_BLOCK_SIZE;
+      continue;
+    }
+
+    size_t n = HUFFMAN_BLOCK_SIZE - enc->len;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(enc->block + enc->len, data, n);
+    enc->len += n;
+    data += n;
+    len -= n;
+
+    if (enc->len == HUFFMAN_BLOCK_SIZE) {
+      encode_block(enc, enc->block, enc->len);
+      enc->len = 0;
+    }
+  }
+}
+
+/*
+ * Emits any buffered input and the end of stream marker, then frees the
+ * encoder.
+ */
+void huffman_encoder_finish(huffman_encoder_t *enc) {
+  encode_block(enc, enc->block, enc->len);
+
+  enc->out[0] = BLOCK_END;
+  put_le32(enc->out + 1, 0);
+  enc->output(enc->ctx, enc->out, BLOCK_HEADER_SIZE);
+  huffman_order1_free(enc->order1);
+  free(enc);
+}
+
+/*
+ * Allocates a decoder that passes the decoded bytes to the given callback.
+ */
+huffman_decoder_t *huffman_decoder_init(huffman_output_fn output, void *ctx) {
+  huffman_decoder_t *dec = malloc(sizeof(huffman_decoder_t));
+  if (dec == NULL) {
+    perror("huffman_decoder_init");
+    exit(EXIT_FAILURE);
+  }
+  dec->output = output;
+  dec->ctx = ctx;
+  dec->error = HUFFMAN_OK;
+  dec->state = READ_MAGIC;
+  dec->target = dec->header;
+  dec->have = 0;
+  dec->need = MAGIC_SIZE;
+  dec->order1 = NULL;
+  return dec;
+}
+
+/*
+ * Moves the decoder into state, gathering the next need bytes into target.
+ */
+static void expect(huffman_decoder_t *dec, decoder_state_t state,
+                   uint8_t *target, size_t need) {
+  dec->state = state;
+  dec->target = target;
+  dec->have = 0;
+  dec->need = need;
+}
+
+/*
+ * Acts on a completely gathered field and selects the next one.
+ */
+static huffman_error_t advance(huffman_decoder_t *dec) {
+  switch (dec->state) {
+    case READ_MAGIC:
+      dec->mode = dec->field[3];
+      if (memcmp(dec->field, "HUF", 3) ||
+          (dec->mode != HUFFMAN_STATIC && dec->mode != HUFFMAN_ADAPTIVE &&
+           dec->mode != HUFFMAN_ORDER1 && dec->mode != HUFFMAN_INTERLEAVED)) {
+        return HUFFMAN_BAD_MAGIC;
+      }
+      if (dec->mode == HUFFMAN_ADAPTIVE) {
+        huffman_model_init(&dec->model);
+      }
+      if (dec->mode == HUFFMAN_ORDER1) {
+        dec->order1 = huffman_order1_alloc();
+      }
+      expect(dec, READ_BLOCK_HEADER, dec->header, BLOCK_HEADER_SIZE);
+      return HUFFMAN_OK;
+
+    case READ_BLOCK_HEADER:
+      dec->type = dec->field[0];
+      dec->raw_len = get_le32(dec->field + 1);
+      if (dec->type == BLOCK_END) {
+        expect(dec, STREAM_DONE, NULL, 0);
+        return dec->raw_len ? HUFFMAN_CORRUPT : HUFFMAN_OK;
+      }
+      if (dec->raw_len == 0 || dec->raw_len > HUFFMAN_BLOCK_SIZE) {
+        return HUFFMAN_CORRUPT;
+      }
+      if (dec->mode == HUFFMAN_ADAPTIVE) {
+        if (dec->type != BLOCK_ADAPTIVE) {
+          return HUFFMAN_CORRUPT;
+        }
+        expect(dec, READ_PAYLOAD_HEADER, dec->header, PAYLOAD_HEADER_SIZE);
+      } else if (dec->type == BLOCK_STORED) {
+        expect(dec, READ_STORED, NULL, dec->raw_len);
+      } else if (dec->type == BLOCK_HUFFMAN || dec->type == BLOCK_HUFFMAN4) {
+        expect(dec, READ_HUFFMAN_HEADER, dec->header, HUFFMAN_HEADER_SIZE);
+      } else if (dec->type == BLOCK_ORDER1 && dec->order1) {
+        expect(dec, READ_PAYLOAD_HEADER, dec->header, PAYLOAD_HEADER_SIZE);
+      } else {
+        return HUFFMAN_CORRUPT;
+      }
+      return HUFFMAN_OK;
+
+    case READ_HUFFMAN_HEADER: {
+      uint32_t payload_len = get_le32(dec->field);
+      if (payload_len > PAYLOAD_SIZE ||
+          huffman_code_read_lengths(&dec->code, dec->field + 4)) {
+        return HUFFMAN_CORRUPT;
+      }
+      huffman_lookup_build(&dec->lookup, &dec->code);
+      expect(dec, READ_PAYLOAD, dec->payload, payload_len);
+      return HUFFMAN_OK;
+    }
+
+    case READ_PAYLOAD_HEADER: {
+      uint32_t payload_len = get_le32(dec->field);
+      if (payload_len > PAYLOAD_SIZE) {
+        return HUFFMAN_CORRUPT;
+      }
+      expect(dec, READ_PAYLOAD, dec->payload, payload_len);
+      return HUFFMAN_OK;
+    }
+
+    case READ_PAYLOAD: {
+      int err;
+      if (dec->type == BLOCK_ADAPTIVE) {
+        err = huffman_adaptive_decode(&dec->model, dec->field, dec->have,
+                                      dec->block, dec->raw_len);
+      } else if (dec->type == BLOCK_ORDER1) {
+        err = huffman_order1_decode(dec->order1, dec->field, dec->have,
+                                    dec->block, dec->raw_len);
+      } else if (dec->type == BLOCK_HUFFMAN4) {
+        err = huffman_block_decode4(&dec->lookup, dec->field, dec->have,
+                                    dec->block, dec->raw_len);
+      } else {
+        err = huffman_block_decode_lookup(&dec->lookup, dec->field,
+                                          dec->have, dec->block, dec->raw_len);
+      }
+      if (err) {
+        return HUFFMAN_CORRUPT;
+      }
+      dec->output(dec->ctx, dec->block, dec->raw_len);
+      expect(dec, READ_BLOCK_HEADER, dec->header, BLOCK_HEADER_SIZE);
+      return HUFFMAN_OK;
+    }
+
+    case READ_STORED:
+      expect(dec, READ_BLOCK_HEADER, dec->header, BLOCK_HEADER_SIZE);
+      return HUFFMAN_OK;
+
+    default:
+      return HUFFMAN_CORRUPT;
+  }
+}
+
+/*
+ * Feeds len bytes of encoded data to the decoder. Decoded output is emitted
+ * a block at a time. A field that lies wholly within data is decoded where it
+ * is rather than copied, so a memory-mapped stream is read in place. Once an
+ * error has been returned, every later call returns it too.
+ */
+huffman_error_t huffman_decoder_feed(huffman_decoder_t *dec,
+                                     const uint8_t *data, size_t len) {
+  while (len > 0 && dec->error == HUFFMAN_OK) {
+    if (dec->state == STREAM_DONE) {
+      // trailing garbage after the end marker
+      dec->error = HUFFMAN_CORRUPT;
+      break;
+    }
+
+    size_t n = dec->need - dec->have;
+    if (n > len) {
+      n = len;
+    }
+    if (dec->state == READ_STORED) {
+      dec->output(dec->ctx, data, n);
+    } else if (dec->have == 0 && n == dec->need) {
+      dec->field = data;
+    } else {
+      memcpy(dec->target + dec->have, data, n);
+      dec->field = dec->target;
+    }
+    dec->have += n;
+    data += n;
+    len -= n;
+
+    if (dec->have == dec->need) {
+      dec->error = advance(dec);
+    }
+  }
+  return dec->error;
+}
+
+/*
+ * Checks that the whole stream has been decoded, then frees the decoder.
+ */
+huffman_error_t huffman_decoder_finish(huffman_decoder_t *dec) {
+  huffman_error_t error = dec->error;
+  if (error == HUFFMAN_OK && dec->state != STREAM_DONE) {
+    error = HUFFMAN_TRUNCATED;
+  }
+  huffman_order1_free(dec->order1);
+  free(dec);
+  return error;
+}
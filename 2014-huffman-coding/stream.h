@@ -0,0 +1,63 @@
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming Huffman coder. Input is fed in chunks of any size and output is
+ * handed to a callback as it is produced; neither side ever holds more than
+ * one block of HUFFMAN_BLOCK_SIZE symbols.
+ *
+ * Stream format: the magic bytes "HUF" and a mode byte, followed by blocks.
+ * Each block starts with a type byte and the little-endian 32 bit number of
+ * bytes it decodes to:
+ *
+ *   BLOCK_END       no further fields; terminates the stream
+ *   BLOCK_STORED    the raw bytes
+ *   BLOCK_HUFFMAN   32 bit payload size, packed code lengths, payload
+ *   BLOCK_ADAPTIVE  32 bit payload size, payload
+ *   BLOCK_ORDER1    32 bit payload size, context tables and payload
+ *   BLOCK_HUFFMAN4  as BLOCK_HUFFMAN, with four interleaved streams
+ *
+ * A HUFFMAN_STATIC stream counts each block before coding it and sends its
+ * code lengths. A HUFFMAN_ORDER1 stream does the same, but also tries a
+ * table per preceding byte (see context.h) and keeps whichever is smaller.
+ * A HUFFMAN_INTERLEAVED stream splits each static block into four streams
+ * (see interleave.h) for faster decoding.
+ * A HUFFMAN_ADAPTIVE stream codes symbols in a single pass with a model (see
+ * adaptive.h) that carries over from block to block.
+ */
+
+typedef enum {
+  HUFFMAN_STATIC = 'S',
+  HUFFMAN_ADAPTIVE = 'A',
+  HUFFMAN_ORDER1 = 'O',
+  HUFFMAN_INTERLEAVED = 'I'
+} huffman_mode_t;
+
+typedef void (*huffman_output_fn)(void *, const uint8_t *, size_t);
+
+typedef enum {
+  HUFFMAN_OK,
+  HUFFMAN_BAD_MAGIC,
+  HUFFMAN_CORRUPT,
+  HUFFMAN_TRUNCATED
+} huffman_error_t;
+
+typedef struct huffman_encoder huffman_encoder_t;
+typedef struct huffman_decoder huffman_decoder_t;
+
+void huffman_print_error(huffman_error_t);
+
+huffman_encoder_t *huffman_encoder_init(huffman_mode_t, huffman_output_fn,
+                                        void *);
+void huffman_encoder_feed(huffman_encoder_t *, const uint8_t *, size_t);
+void huffman_encoder_finish(huffman_encoder_t *);
+
+huffman_decoder_t *huffman_decoder_init(huffman_output_fn, void *);
+huffman_error_t huffman_decoder_feed(huffman_decoder_t *, const uint8_t *,
+                                     size_t);
+huffman_error_t huffman_decoder_finish(huffman_decoder_t *);
+
+#endif
@@ -0,0 +1,412 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "image.h"
+#include "image_map.h"
+#include "integral.h"
+#include "region.h"
+#include "pool.h"
+#include "scan.h"
+#include "typedefs.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Runs region detection over many images on a pool of worker threads. Each
+// input "dir/name.pgm" produces "outdir/name_regions.txt" and
+// "outdir/name_output.pgm", which are the regions.txt and output.pgm that
+// the regions program would write for it. Inputs that share a name are
+// refused before any work starts, since their outputs would overwrite each
+// other.
+
+enum {MAX_PATH_LENGTH = 4096};
+
+// The work shared by the pool: workers take the next input under the lock.
+typedef struct
+{
+  char **inputs;
+  int count;
+  const char *outdir;
+  int validate;
+  int next;
+  int failures;
+  pthread_mutex_t lock;
+} batch_t;
+
+// Returns the stem of "input", its file name without its directory and
+// extension, setting "length" to the number of characters in it.
+static const char *input_stem(const char *input, int *length)
+{
+  const char *name = strrchr(input, '/');
+  name = name ? name + 1 : input;
+  const char *dot = strrchr(name, '.');
+  *length = dot && dot != name ? (int) (dot - name) : (int) strlen(name);
+  return name;
+}
+
+// Sets "out" to "outdir/stem" + "suffix", where stem is the input's
+// input_stem(). Returns 0 on success or -1 if the path is too long.
+static int output_path(char *out, const char *outdir, const char *input,
+                       const char *suffix)
+{
+  int stem;
+  const char *name = input_stem(input, &stem);
+
+  int n = snprintf(out, MAX_PATH_LENGTH, "%s/%.*s%s", outdir, stem, name,
+                   suffix);
+  return n < MAX_PATH_LENGTH ? 0 : -1;
+}
+
+static int compare_stems(const void *a, const void *b)
+{
+  int n1, n2;
+  const char *s1 = input_stem(*(char *const *) a, &n1);
+  const char *s2 = input_stem(*(char *const *) b, &n2);
+  int c = memcmp(s1, s2, n1 < n2 ? n1 : n2);
+  return c ? c : (n1 > n2) - (n1 < n2);
+}
+
+// Reports every pair of inputs that share a stem, and so would write the
+// same output files. Returns the number of such pairs.
+static int check_stems(char **inputs, int count)
+{
+  char **sorted = malloc((count > 0 ? count : 1) * sizeof(char *));
+  if (sorted == NULL)
+  {
+    perror("check_stems");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(sorted, inputs, count * sizeof(char *));
+  qsort(sorted, count, sizeof(char *), compare_stems);
+
+  int clashes = 0;
+  for (int i = 1; i < count; i++)
+  {
+    if (compare_stems(&sorted[i - 1], &sorted[i]) == 0)
+    {
+      fprintf(stderr, "%s and %s would both write the same outputs\n",
+              sorted[i - 1], sorted[i]);
+      clashes++;
+    }
+  }
+
+  free(sorted);
+  return clashes;
+}
+
+// What a worker keeps from one image to the next: the pool and tables are
+// emptied and refilled for each image, so they are only reallocated when an
+// image needs more room than every one before it.
+typedef struct
+{
+  region_pool_t regions;
+  integral_t table;
+  char path[MAX_PATH_LENGTH];
+} worker_state_t;
+
+// Detects, prints and renders the regions of one input, then checks them
+// against the image's summed-area tables if "validate" is set. Returns
+// 0 on success, otherwise reports the problem and returns -1.
+static int process_image(const char *input, const char *outdir, int validate,
+                         worker_state_t *state)
+{
+  image_t *img_in = NULL;
+  image_error_t img_err = image_map_read(input, &img_in);
+  if (img_err)
+  {
+    fprintf(stderr, "%s: ", input);
+    image_print_error(img_err);
+    return -1;
+  }
+
+  // the pool already keeps every processor busy, so each image is scanned
+  // on its worker alone
+  region_pool_t *regions = &state->regions;
+  char *path = state->path;
+  region_pool_clear(regions);
+  scan_regions(regions, img_in);
+
+  int result = 0;
+  FILE *text_out = NULL;
+  if (output_path(path, outdir, input, "_regions.txt") ||
+      (text_out = fopen(path, "w")) == NULL)
+  {
+    perror(path);
+    result = -1;
+  }
+  else
+  {
+    region_pool_print(text_out, regions);
+    if (fclose(text_out))
+    {
+      perror(path);
+      result = -1;
+    }
+  }
+
+  // render straight into the mapped output file
+  image_t *img_out = NULL;
+  if (result == 0 && output_path(path, outdir, input, "_output.pgm"))
+  {
+    fprintf(stderr, "%s: output path too long\n", input);
+    result = -1;
+  }
+  else if (result == 0)
+  {
+    img_err = image_map_create(path, &img_out, img_in->width, img_in->height,
+                               PGM_FORMAT);
+    if (!img_err)
+    {
+      render_pooled_regions(img_out, regions, region_colour);
+      img_err = image_unmap(img_out);
+    }
+    if (img_err)
+    {
+      fprintf(stderr, "%s: ", path);
+      image_print_error(img_err);
+      result = -1;
+    }
+  }
+
+  if (validate)
+  {
+    integral_update(&state->table, img_in);
+    int invalid = validate_pooled_regions(&state->table, regions, NULL);
+    if (invalid)
+    {
+      fprintf(stderr, "%s: %d of %d regions failed validation\n", input,
+              invalid, regions->count);
+      result = -1;
+    }
+  }
+
+  image_unmap(img_in);
+  return result;
+}
+
+static void *worker(void *arg)
+{
+  batch_t *batch = arg;
+  worker_state_t *state = malloc(sizeof(worker_state_t));
+  if (state == NULL)
+  {
+    perror("worker");
+    exit(EXIT_FAILURE);
+  }
+  region_pool_init(&state->regions);
+  memset(&state->table, 0, sizeof(state->table));
+
+  for (;;)
+  {
+    pthread_mutex_lock(&batch->lock);
+    int i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if (i >= batch->count)
+    {
+      break;
+    }
+
+    if (process_image(batch->inputs[i], batch->outdir, batch->validate,
+                      state))
+    {
+      pthread_mutex_lock(&batch->lock);
+      batch->failures++;
+      pthread_mutex_unlock(&batch->lock);
+    }
+  }
+
+  integral_destroy(&state->table);
+  region_pool_destroy(&state->regions);
+  free(state);
+  return NULL;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+  return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+// Appends "path" to the growable array of inputs.
+static void add_input(char ***inputs, int *count, int *capacity,
+                      const char *path)
+{
+  if (*count == *capacity)
+  {
+    *capacity = 2 * *capacity + 16;
+    *inputs = realloc(*inputs, *capacity * sizeof(char *));
+    if (*inputs == NULL)
+    {
+      perror("add_input");
+      exit(EXIT_FAILURE);
+    }
+  }
+  (*inputs)[*count] = malloc(strlen(path) + 1);
+  if ((*inputs)[*count] == NULL)
+  {
+    perror("add_input");
+    exit(EXIT_FAILURE);
+  }
+  strcpy((*inputs)[(*count)++], path);
+}
+
+// Adds every .pgm file in directory "dir" to the inputs, in name order,
+// except the renderings this program writes, so that a directory that is
+// also the output directory can be processed again. Returns 0 on success or
+// -1 if the directory cannot be read.
+static int add_directory(char ***inputs, int *count, int *capacity,
+                         const char *dir)
+{
+  DIR *d = opendir(dir);
+  if (d == NULL)
+  {
+    perror(dir);
+    return -1;
+  }
+
+  int first = *count;
+  char path[MAX_PATH_LENGTH];
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL)
+  {
+    static const char suffix[] = "_output.pgm";
+    const size_t suffix_len = sizeof(suffix) - 1;
+    size_t len = strlen(entry->d_name);
+    if (len > 4 && strcmp(entry->d_name + len - 4, ".pgm") == 0 &&
+        !(len >= suffix_len &&
+          strcmp(entry->d_name + len - suffix_len, suffix) == 0) &&
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) <
+        (int) sizeof(path))
+    {
+      add_input(inputs, count, capacity, path);
+    }
+  }
+  closedir(d);
+
+  qsort(*inputs + first, *count - first, sizeof(char *), compare_names);
+  return 0;
+}
+
+static double seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void usage(const char *program)
+{
+  fprintf(stderr, "Usage: %s [-j threads] [-o outdir] [-v] input...\n",
+          program);
+  fprintf(stderr, "Each input is a PGM image or a directory of them. For "
+          "name.pgm, regions are\nwritten to outdir/name_regions.txt and "
+          "the rendering to outdir/name_output.pgm, so no two inputs\nmay "
+          "share a name, and files named *_output.pgm in a directory are "
+          "skipped.\n-v checks the regions found against the image.\n");
+}
+
+int main(int argc, char **argv)
+{
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *outdir = ".";
+  int validate = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:o:v")) != -1)
+  {
+    switch (opt)
+    {
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      case 'o':
+        outdir = optarg;
+        break;
+      case 'v':
+        validate = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (optind == argc || threads < 1)
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  batch_t batch = {NULL, 0, outdir, validate, 0, 0};
+  int capacity = 0;
+  for (int i = optind; i < argc; i++)
+  {
+    struct stat st;
+    if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+    {
+      if (add_directory(&batch.inputs, &batch.count, &capacity, argv[i]))
+      {
+        batch.failures++;
+      }
+    }
+    else
+    {
+      add_input(&batch.inputs, &batch.count, &capacity, argv[i]);
+    }
+  }
+  // two workers writing one output would race, so refuse before starting
+  if (check_stems(batch.inputs, batch.count))
+  {
+    for (int i = 0; i < batch.count; i++)
+    {
+      free(batch.inputs[i]);
+    }
+    free(batch.inputs);
+    return EXIT_FAILURE;
+  }
+  if (threads > batch.count)
+  {
+    threads = batch.count > 0 ? batch.count : 1;
+  }
+
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_t *ids = malloc(threads * sizeof(pthread_t));
+  if (ids == NULL)
+  {
+    perror("batch_regions");
+    exit(EXIT_FAILURE);
+  }
+
+  int failed_inputs = batch.failures;
+  double start = seconds();
+  for (int t = 0; t < threads; t++)
+  {
+    if (pthread_create(&ids[t], NULL, worker, &batch))
+    {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int t = 0; t < threads; t++)
+  {
+    pthread_join(ids[t], NULL);
+  }
+  double elapsed = seconds() - start;
+
+  // only the images that were processed successfully count as throughput
+  int done = batch.count - (batch.failures - failed_inputs);
+  fprintf(stderr, "%d images (%d failed) on %ld threads in %.3f s: "
+          "%.1f images/sec\n", batch.count, batch.failures, threads, elapsed,
+          elapsed > 0 ? done / elapsed : 0.0);
+
+  pthread_mutex_destroy(&batch.lock);
+  for (int i = 0; i < batch.count; i++)
+  {
+    free(batch.inputs[i]);
+  }
+  free(batch.inputs);
+  free(ids);
+  return batch.failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
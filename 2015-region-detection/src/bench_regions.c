@@ -0,0 +1,353 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "image.h"
+#include "image_map.h"
+#include "integral.h"
+#include "label.h"
+#include "region.h"
+#include "list.h"
+#include "pool.h"
+#include "quadtree.h"
+#include "scan.h"
+#include "typedefs.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Region detection benchmark. For each image named on the command line it
+// times image I/O, detection, index queries, rendering and validation
+// separately, checks the regions found against the image's summed-area
+// tables, and compares them with a regions.txt style file given straight
+// after the image, such as one from ../reference_outputs or from
+// generate_regions.
+//
+// Usage: bench_regions image.pgm [regions.txt] ...
+
+// Each phase is repeated until it has run for at least this long.
+static const double MIN_PHASE_TIME = 0.2;
+
+// The file written by the output phases.
+static const char *bench_output = "bench_output.pgm";
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check(image_error_t img_err)
+{
+  if (img_err)
+  {
+    image_print_error(img_err);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// The state shared by the phases for one image.
+typedef struct
+{
+  const char *filename;
+  image_t *image;
+  image_t *rendered;
+  list_t regions;
+  region_pool_t pool;
+  region_index_t index;
+  integral_t table;
+} bench_t;
+
+static void phase_read(bench_t *b)
+{
+  image_t *image;
+  check(image_read(b->filename, &image));
+  image_free(image);
+}
+
+static void phase_map_read(bench_t *b)
+{
+  image_t *image;
+  check(image_map_read(b->filename, &image));
+  image_unmap(image);
+}
+
+static void phase_find(bench_t *b)
+{
+  list_t regions;
+  list_init(&regions);
+  find_regions(&regions, b->image);
+  list_destroy(&regions);
+}
+
+static void phase_find_pool(bench_t *b)
+{
+  region_pool_t pool;
+  region_pool_init(&pool);
+  find_pooled_regions(&pool, b->image);
+  region_pool_destroy(&pool);
+}
+
+static void phase_scan(bench_t *b)
+{
+  region_pool_t pool;
+  region_pool_init(&pool);
+  scan_regions(&pool, b->image);
+  region_pool_destroy(&pool);
+}
+
+static void phase_label(bench_t *b)
+{
+  component_set_t components;
+  label_components(&components, b->image);
+  component_set_destroy(&components);
+}
+
+static void phase_index(bench_t *b)
+{
+  region_index_t index;
+  region_index_build(&index, &b->pool, b->image->width, b->image->height);
+  region_index_destroy(&index);
+}
+
+static void count_visit(void *ctx, int index)
+{
+  (void) index;
+  (*(long *) ctx)++;
+}
+
+// Each run looks up the innermost region of QUERY_POINTS pixels and the
+// regions meeting QUERY_RECTS small rectangles, spread over the image by a
+// fixed sequence so that every run asks the same questions.
+enum {QUERY_POINTS = 1 << 16, QUERY_RECTS = 1 << 12, QUERY_RECT_SIZE = 16};
+
+// What the queries found, kept so that they are not optimised away.
+static volatile long query_found;
+
+static void phase_query(bench_t *b)
+{
+  const int width = b->image->width, height = b->image->height;
+  uint64_t seed = 1;
+  long found = 0;
+  for (int i = 0; i < QUERY_POINTS; i++)
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    found += region_index_innermost(&b->index, (seed >> 33) % width,
+                                    (seed >> 13) % height) >= 0;
+  }
+  for (int i = 0; i < QUERY_RECTS; i++)
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    region_index_intersecting(&b->index, (seed >> 33) % width,
+                              (seed >> 13) % height, QUERY_RECT_SIZE,
+                              QUERY_RECT_SIZE, count_visit, &found);
+  }
+  query_found = found;
+}
+
+static void phase_render(bench_t *b)
+{
+  render_regions(b->rendered, &b->regions, region_colour);
+}
+
+static void phase_render_pool(bench_t *b)
+{
+  render_pooled_regions(b->rendered, &b->pool, region_colour);
+}
+
+static void phase_overdraw(bench_t *b)
+{
+  render_regions_overdraw(b->rendered, &b->regions, region_colour);
+}
+
+static void phase_integral(bench_t *b)
+{
+  integral_t table;
+  integral_init(&table, b->image);
+  integral_destroy(&table);
+}
+
+static void phase_validate(bench_t *b)
+{
+  validate_pooled_regions(&b->table, &b->pool, NULL);
+}
+
+static void phase_write(bench_t *b)
+{
+  check(image_write(bench_output, b->rendered, PGM_FORMAT));
+}
+
+static void phase_map_write(bench_t *b)
+{
+  image_t *out;
+  check(image_map_create(bench_output, &out, b->rendered->width,
+                         b->rendered->height, PGM_FORMAT));
+  memcpy(out->pixelsData, b->rendered->pixelsData,
+         (size_t) b->rendered->widthStep * b->rendered->height);
+  check(image_unmap(out));
+}
+
+// Runs phase repeatedly for at least MIN_PHASE_TIME and prints its time per
+// run and its throughput over the image.
+static void time_phase(const char *name, void (*phase)(bench_t *),
+                       bench_t *b)
+{
+  int runs = 0;
+  double start = now(), elapsed;
+  do
+  {
+    phase(b);
+    runs++;
+    elapsed = now() - start;
+  } while (elapsed < MIN_PHASE_TIME);
+
+  double pixels = (double) b->image->width * b->image->height;
+  printf("  %-10s %10.3f ms %9.1f Mpixel/s\n", name, 1e3 * elapsed / runs,
+         runs * (pixels / 1e6) / elapsed);
+}
+
+// Compares the regions found with the expected file, line by line. Returns
+// 0 if they match, otherwise reports the first difference and returns -1.
+static int validate(list_t *regions, const char *expected_file)
+{
+  FILE *expected = fopen(expected_file, "r");
+  if (expected == NULL)
+  {
+    perror(expected_file);
+    return -1;
+  }
+  FILE *found = tmpfile();
+  if (found == NULL)
+  {
+    perror("tmpfile");
+    exit(EXIT_FAILURE);
+  }
+  print_regions(found, regions);
+  rewind(found);
+
+  char want[256], got[256];
+  int line = 0, result = 0;
+  for (;;)
+  {
+    char *w = fgets(want, sizeof(want), expected);
+    char *g = fgets(got, sizeof(got), found);
+    line++;
+    if (w == NULL && g == NULL)
+    {
+      break;
+    }
+    if (w == NULL || g == NULL || strcmp(want, got) != 0)
+    {
+      printf("  validation FAILED at line %d of %s\n    expected: %s"
+             "    found:    %s", line, expected_file, w ? want : "(end)\n",
+             g ? got : "(end)\n");
+      result = -1;
+      break;
+    }
+  }
+  if (result == 0)
+  {
+    printf("  validation ok against %s (%d regions)\n", expected_file,
+           line - 1);
+  }
+
+  fclose(found);
+  fclose(expected);
+  return result;
+}
+
+// Benchmarks one image, validating against "expected_file" if it is not
+// NULL. Returns 0 on success or -1 if validation failed.
+static int bench_image(const char *filename, const char *expected_file)
+{
+  bench_t b;
+  b.filename = filename;
+  check(image_read(filename, &b.image));
+  check(init_image(&b.rendered, b.image->width, b.image->height, GRAY,
+                   DEPTH));
+  list_init(&b.regions);
+  find_regions(&b.regions, b.image);
+  region_pool_init(&b.pool);
+  find_pooled_regions(&b.pool, b.image);
+  region_index_build(&b.index, &b.pool, b.image->width, b.image->height);
+
+  int regions = 0;
+  for (list_iter e = list_begin(&b.regions); e != list_end(&b.regions);
+       e = list_iter_next(e))
+  {
+    regions++;
+  }
+  printf("%s (%dx%d, %d regions)\n", filename, b.image->width,
+         b.image->height, regions);
+
+  int result = expected_file ? validate(&b.regions, expected_file) : 0;
+
+  // check the regions against the image itself, too
+  integral_init(&b.table, b.image);
+  int invalid = validate_pooled_regions(&b.table, &b.pool, stdout);
+  printf("  %d regions failed validation against the image\n", invalid);
+  if (invalid)
+  {
+    result = -1;
+  }
+
+  time_phase("read", phase_read, &b);
+  time_phase("map read", phase_map_read, &b);
+  time_phase("find", phase_find, &b);
+  time_phase("find pool", phase_find_pool, &b);
+  time_phase("scan", phase_scan, &b);
+  time_phase("label", phase_label, &b);
+  time_phase("index", phase_index, &b);
+  time_phase("query", phase_query, &b);
+  time_phase("render", phase_render, &b);
+  time_phase("rndr pool", phase_render_pool, &b);
+  time_phase("overdraw", phase_overdraw, &b);
+  time_phase("integral", phase_integral, &b);
+  time_phase("validate", phase_validate, &b);
+  time_phase("write", phase_write, &b);
+  time_phase("map write", phase_map_write, &b);
+  remove(bench_output);
+
+  list_destroy(&b.regions);
+  region_index_destroy(&b.index);
+  region_pool_destroy(&b.pool);
+  integral_destroy(&b.table);
+  image_free(b.image);
+  image_free(b.rendered);
+  return result;
+}
+
+static int has_suffix(const char *s, const char *suffix)
+{
+  size_t len = strlen(s), suffix_len = strlen(suffix);
+  return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2 || has_suffix(argv[1], ".txt"))
+  {
+    fprintf(stderr, "Usage: %s image.pgm [regions.txt] ...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int failures = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *expected = NULL;
+    if (i + 1 < argc && has_suffix(argv[i + 1], ".txt"))
+    {
+      expected = argv[i + 1];
+    }
+    if (bench_image(argv[i], expected))
+    {
+      failures++;
+    }
+    if (expected)
+    {
+      i++;
+    }
+  }
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
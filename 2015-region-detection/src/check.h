@@ -0,0 +1,36 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// The harness shared by the check programs: each failed check is printed and
+// counted, and check_summary() turns the count into the exit status.
+
+// The number of checks failed so far.
+static int failures = 0;
+
+// Counts a failure, and prints "what", unless "ok" is set.
+static void check(int ok, const char *what)
+{
+  if (!ok)
+  {
+    printf("FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+// Prints "passed" if every check passed, otherwise the number that failed.
+// Returns the exit status for main().
+static int check_summary(const char *passed)
+{
+  if (failures > 0)
+  {
+    printf("%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("%s\n", passed);
+  return EXIT_SUCCESS;
+}
+
+#endif
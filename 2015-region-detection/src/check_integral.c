@@ -0,0 +1,180 @@
+#include "check.h"
+#include "image.h"
+#include "image_fast.h"
+#include "integral.h"
+#include "pool.h"
+#include "region.h"
+#include "typedefs.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Checks integral_find_mismatch() against a pixel by pixel search on the
+// sample images, and that validate_pooled_regions() locates a pixel that
+// breaks a region. Run from the src directory, as the images are found
+// through ../images.
+
+static int inside(const region_t *region, int x, int y)
+{
+  return x >= region->position.x && y >= region->position.y &&
+         x < region->position.x + region->extent.width &&
+         y < region->position.y + region->extent.height;
+}
+
+// Finds the first pixel of "area" outside "holes" that is not of "shade" by
+// looking at every pixel.
+static int slow_mismatch(const image_t *image, const region_t *area,
+                         const region_t *const *holes, int count,
+                         uint8_t shade, point_t *at)
+{
+  for (int y = area->position.y;
+       y < area->position.y + area->extent.height; y++)
+  {
+    for (int x = area->position.x;
+         x < area->position.x + area->extent.width; x++)
+    {
+      int covered = 0;
+      for (int i = 0; i < count && !covered; i++)
+      {
+        covered = inside(holes[i], x, y);
+      }
+      if (!covered && get_pixel_fast(image, x, y) != shade)
+      {
+        at->x = x;
+        at->y = y;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Compares the two searches over "area" with and without "holes", for the
+// shade of its first pixel and for one other shade.
+static void check_area(const image_t *image, const integral_t *table,
+                       const region_t *area, const region_t *const *holes,
+                       int count)
+{
+  const uint8_t first = get_pixel_fast(image, area->position.x,
+                                       area->position.y);
+  const uint8_t shades[] = {first, (uint8_t) (first + 1)};
+  for (int s = 0; s < 2; s++)
+  {
+    for (int c = 0; c <= count; c += count > 0 ? count : 1)
+    {
+      point_t fast = {-1, -1}, slow = {-1, -1};
+      int found = integral_find_mismatch(table, area, holes, c, shades[s],
+                                         &fast);
+      check(found == slow_mismatch(image, area, holes, c, shades[s], &slow),
+            "a mismatch is found exactly when there is one");
+      check(!found || (fast.x == slow.x && fast.y == slow.y),
+            "the first mismatch in [y, x] order is found");
+    }
+  }
+}
+
+static void check_image(const char *filename)
+{
+  printf("%s... ", filename);
+  fflush(stdout);
+
+  image_t *image = NULL;
+  image_error_t err = image_read(filename, &image);
+  if (err)
+  {
+    image_print_error(err);
+    failures++;
+    return;
+  }
+  region_pool_t pool;
+  region_pool_init(&pool);
+  find_pooled_regions(&pool, image);
+  integral_t table;
+  integral_init(&table, image);
+
+  const int before = failures;
+  const region_t **holes = malloc((pool.count + 1) * sizeof(region_t *));
+  if (holes == NULL)
+  {
+    perror("check_image");
+    exit(EXIT_FAILURE);
+  }
+
+  // every region, with its sub-regions as holes
+  for (int i = 0; i < pool.count; i++)
+  {
+    const region_t *region = &pool.regions[i];
+    int count = 0;
+    for (int j = i + 1; j < pool.count; j++)
+    {
+      const region_t *child = &pool.regions[j];
+      if (child->depth == region->depth + 1 &&
+          inside(region, child->position.x, child->position.y))
+      {
+        holes[count++] = child;
+      }
+    }
+    check_area(image, &table, region, holes, count);
+  }
+
+  // rectangles spread over the image, which cross region edges
+  uint64_t seed = 42;
+  for (int i = 0; i < 200; i++)
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    region_t area;
+    area.position.x = (seed >> 33) % image->width;
+    area.position.y = (seed >> 13) % image->height;
+    area.extent.width = 1 + (seed >> 45) % (image->width - area.position.x);
+    area.extent.height = 1 + (seed >> 25) % (image->height - area.position.y);
+    area.depth = 0;
+    check_area(image, &table, &area, holes, 0);
+  }
+
+  check(validate_pooled_regions(&table, &pool, NULL) == 0,
+        "the detected regions are valid");
+  free(holes);
+  integral_destroy(&table);
+
+  // break the last region's shade at its bottom right pixel; sub-regions
+  // come after their parent, so the last region has none to cover it
+  if (pool.count > 0)
+  {
+    const region_t *last = &pool.regions[pool.count - 1];
+    const int x = last->position.x + last->extent.width - 1;
+    const int y = last->position.y + last->extent.height - 1;
+    set_pixel_fast(image, x, y, get_pixel_fast(image, x, y) ^ 1);
+    integral_init(&table, image);
+
+    FILE *out = tmpfile();
+    char report[256] = "", expected[64];
+    check(validate_pooled_regions(&table, &pool, out) == 1,
+          "one region fails after a pixel is changed");
+    rewind(out);
+    check(fgets(report, sizeof(report), out) != NULL, "the failure is told");
+    fclose(out);
+    snprintf(expected, sizeof(expected), "pixel (%d, %d) differs", x, y);
+    check(strstr(report, expected) != NULL, "the changed pixel is located");
+    integral_destroy(&table);
+  }
+
+  printf("%s\n", failures == before ? "ok" : "failed");
+  region_pool_destroy(&pool);
+  image_free(image);
+}
+
+int main(void)
+{
+  static const char *const images[] = {
+    "../images/input1.pgm", "../images/input2.pgm", "../images/input3.pgm",
+    "../images/input4.pgm", "../images/input5.pgm", "../images/input6.pgm",
+    "../images/input7.pgm"
+  };
+  for (size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++)
+  {
+    check_image(images[i]);
+  }
+
+  return check_summary("All integral_find_mismatch() checks passed");
+}
@@ -0,0 +1,176 @@
+#include "check.h"
+#include "region.h"
+#include "list.h"
+#include "test_regions.h"
+#include "typedefs.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <memory.h>
+
+// Checks list_append() and list_sort() against region_compare(). Each case
+// appends regions in some order, sorts the list, and checks that it holds the
+// same regions, linked both ways, with no region placed before one that
+// region_compare() says is less than it. Regions with equal positions must
+// keep the order they were appended in.
+
+static void append_copy(list_t *list, const region_t *region)
+{
+  region_t *copy = region_allocate();
+  memcpy(copy, region, sizeof(region_t));
+  list_append(list, copy);
+}
+
+// Sorts the list built from regions[order[0]], regions[order[1]], ... and
+// checks it against "expected", the regions in the order list_sort() must
+// leave them.
+static void check_sort(const char *name, const region_t *regions,
+                       const size_t *order, const region_t *expected,
+                       size_t n)
+{
+  printf("%s (%zu regions)... ", name, n);
+  fflush(stdout);
+
+  list_t list;
+  list_init(&list);
+  for (size_t i = 0; i < n; i++)
+  {
+    append_copy(&list, &regions[order[i]]);
+  }
+  list_sort(&list);
+
+  const int before = failures;
+  size_t i = 0;
+  for (list_iter e = list_begin(&list); e != list_end(&list); e = e->next, i++)
+  {
+    check(e->next->prev == e && e->prev->next == e, "links are consistent");
+    if (i > 0)
+    {
+      check(!region_compare(e->region, e->prev->region),
+            "no region comes before a lesser one");
+    }
+    if (i < n)
+    {
+      check(memcmp(e->region, &expected[i], sizeof(region_t)) == 0,
+            "regions are in the expected order");
+    }
+  }
+  check(i == n, "no region is lost or added");
+  printf("%s\n", failures == before ? "ok" : "failed");
+
+  list_destroy(&list);
+}
+
+static void check_empty(void)
+{
+  printf("empty list... ");
+  fflush(stdout);
+
+  list_t list;
+  list_init(&list);
+  list_sort(&list);
+
+  const int before = failures;
+  check(list_begin(&list) == list_end(&list), "list stays empty");
+  check(list_iter_prev(list_end(&list)) == list.header,
+        "sentinels stay linked");
+  printf("%s\n", failures == before ? "ok" : "failed");
+
+  list_destroy(&list);
+}
+
+static void check_test_regions(void)
+{
+  const size_t n = num_test_regions;
+  size_t forward[n], reversed[n];
+  static const size_t shuffled[] = {6, 1, 4, 3, 5, 0, 2};
+  for (size_t i = 0; i < n; i++)
+  {
+    forward[i] = i;
+    reversed[i] = n - 1 - i;
+  }
+
+  check_sort("already in order", test_regions, forward, test_regions, n);
+  check_sort("reversed", test_regions, reversed, test_regions, n);
+  check_sort("shuffled", test_regions, shuffled, test_regions, n);
+}
+
+static void check_equal_keys(void)
+{
+  // pairs of regions share a position; widths give their appending order
+  static const region_t regions[] = {
+    { .position = { .x = 5, .y = 3 }, .extent = { 1, 1 }, .depth = 0 },
+    { .position = { .x = 0, .y = 0 }, .extent = { 2, 1 }, .depth = 0 },
+    { .position = { .x = 5, .y = 3 }, .extent = { 3, 1 }, .depth = 0 },
+    { .position = { .x = 7, .y = 0 }, .extent = { 4, 1 }, .depth = 0 },
+    { .position = { .x = 0, .y = 0 }, .extent = { 5, 1 }, .depth = 0 },
+    { .position = { .x = 7, .y = 0 }, .extent = { 6, 1 }, .depth = 0 }
+  };
+  static const size_t order[] = {0, 1, 2, 3, 4, 5};
+  static const region_t expected[] = {
+    { .position = { .x = 0, .y = 0 }, .extent = { 2, 1 }, .depth = 0 },
+    { .position = { .x = 0, .y = 0 }, .extent = { 5, 1 }, .depth = 0 },
+    { .position = { .x = 7, .y = 0 }, .extent = { 4, 1 }, .depth = 0 },
+    { .position = { .x = 7, .y = 0 }, .extent = { 6, 1 }, .depth = 0 },
+    { .position = { .x = 5, .y = 3 }, .extent = { 1, 1 }, .depth = 0 },
+    { .position = { .x = 5, .y = 3 }, .extent = { 3, 1 }, .depth = 0 }
+  };
+  check_sort("equal keys", regions, order, expected, 6);
+
+  // every key the same, so every digit is skipped
+  static const region_t same[] = {
+    { .position = { .x = 9, .y = 9 }, .extent = { 3, 1 }, .depth = 0 },
+    { .position = { .x = 9, .y = 9 }, .extent = { 1, 1 }, .depth = 0 },
+    { .position = { .x = 9, .y = 9 }, .extent = { 2, 1 }, .depth = 0 }
+  };
+  static const size_t same_order[] = {0, 1, 2};
+  check_sort("all keys equal", same, same_order, same, 3);
+}
+
+// Orders regions by region_compare(), then by width, for qsort().
+static int compare_then_width(const void *a, const void *b)
+{
+  const region_t *r1 = a, *r2 = b;
+  if (region_compare(r1, r2))
+  {
+    return -1;
+  }
+  if (region_compare(r2, r1))
+  {
+    return 1;
+  }
+  return (r1->extent.width > r2->extent.width) -
+         (r1->extent.width < r2->extent.width);
+}
+
+static void check_large(void)
+{
+  // positions spread over several bytes of the key, with repeats
+  enum { COUNT = 5000 };
+  static region_t regions[COUNT], expected[COUNT];
+  static size_t order[COUNT];
+  uint64_t seed = 12345;
+  for (size_t i = 0; i < COUNT; i++)
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    regions[i].position.x = (seed >> 33) % 70000;
+    regions[i].position.y = (seed >> 17) % 300;
+    regions[i].extent.width = i;
+    regions[i].extent.height = 1;
+    regions[i].depth = 0;
+    order[i] = i;
+  }
+  memcpy(expected, regions, sizeof(regions));
+  qsort(expected, COUNT, sizeof(region_t), compare_then_width);
+
+  check_sort("large, random", regions, order, expected, COUNT);
+}
+
+int main(void)
+{
+  check_empty();
+  check_test_regions();
+  check_equal_keys();
+  check_large();
+
+  return check_summary("All list_sort() checks passed");
+}
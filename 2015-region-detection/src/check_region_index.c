@@ -0,0 +1,209 @@
+#include "check.h"
+#include "image.h"
+#include "image_fast.h"
+#include "pool.h"
+#include "quadtree.h"
+#include "region.h"
+#include "typedefs.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Checks region_index_innermost() and region_index_intersecting() against a
+// pass over every region, on the sample images and on a generated image with
+// thousands of regions. Run from the src directory, as the images are found
+// through ../images.
+
+static uint64_t seed = 7;
+
+static int random_below(int n)
+{
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (int) ((seed >> 33) % n);
+}
+
+// Collects the regions visited by an intersection query.
+typedef struct
+{
+  int *found;
+  int count;
+} visited_t;
+
+static void visit(void *ctx, int index)
+{
+  visited_t *v = ctx;
+  v->found[v->count++] = index;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+  return (*(const int *) a > *(const int *) b) -
+         (*(const int *) a < *(const int *) b);
+}
+
+// Checks one intersection query against every region of the pool.
+static void check_rectangle(const region_index_t *index,
+                            const region_pool_t *pool, int x, int y,
+                            int width, int height, int *found, int *expected)
+{
+  visited_t v = {found, 0};
+  int count = region_index_intersecting(index, x, y, width, height, visit,
+                                        &v);
+
+  int n = 0;
+  for (int i = 0; i < pool->count; i++)
+  {
+    const region_t *r = &pool->regions[i];
+    if (r->position.x < x + width && r->position.x + r->extent.width > x &&
+        r->position.y < y + height && r->position.y + r->extent.height > y)
+    {
+      expected[n++] = i;
+    }
+  }
+
+  qsort(found, v.count, sizeof(int), compare_ints);
+  check(count == v.count, "the count returned is the number visited");
+  check(v.count == n && memcmp(found, expected, n * sizeof(int)) == 0,
+        "exactly the intersecting regions are visited, once each");
+}
+
+static void check_pool(const char *name, image_t *image)
+{
+  printf("%s... ", name);
+  fflush(stdout);
+
+  region_pool_t pool;
+  region_pool_init(&pool);
+  find_pooled_regions(&pool, image);
+  region_index_t index;
+  region_index_build(&index, &pool, image->width, image->height);
+
+  const int before = failures;
+  const int width = image->width, height = image->height;
+
+  // sub-regions come after their parent, so painting the regions' indices
+  // in pool order leaves each pixel with its innermost region
+  int *innermost = malloc((size_t) width * height * sizeof(int));
+  int *found = malloc((pool.count + 1) * sizeof(int));
+  int *expected = malloc((pool.count + 1) * sizeof(int));
+  if (innermost == NULL || found == NULL || expected == NULL)
+  {
+    perror("check_pool");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < width * height; i++)
+  {
+    innermost[i] = -1;
+  }
+  for (int i = 0; i < pool.count; i++)
+  {
+    const region_t *r = &pool.regions[i];
+    for (int y = r->position.y; y < r->position.y + r->extent.height; y++)
+    {
+      for (int x = r->position.x; x < r->position.x + r->extent.width; x++)
+      {
+        innermost[y * width + x] = i;
+      }
+    }
+  }
+
+  int wrong = 0;
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      wrong += region_index_innermost(&index, x, y) != innermost[y * width + x];
+    }
+  }
+  check(wrong == 0, "every pixel finds its innermost region");
+
+  // single pixels, whole rows and columns, the whole image, and rectangles
+  // of every size spread over it
+  check_rectangle(&index, &pool, 0, 0, width, height, found, expected);
+  check_rectangle(&index, &pool, 0, height / 2, width, 1, found, expected);
+  check_rectangle(&index, &pool, width / 2, 0, 1, height, found, expected);
+  for (int i = 0; i < 500; i++)
+  {
+    const int x = random_below(width), y = random_below(height);
+    const int w = 1 + random_below(i % 2 ? width - x : (width - x + 7) / 8);
+    const int h = 1 + random_below(i % 2 ? height - y : (height - y + 7) / 8);
+    check_rectangle(&index, &pool, x, y, w, h, found, expected);
+  }
+  check(region_index_intersecting(&index, 0, 0, 0, height, visit, NULL) == 0,
+        "an empty rectangle finds nothing");
+
+  printf("%s (%d regions)\n", failures == before ? "ok" : "failed",
+         pool.count);
+  free(innermost);
+  free(found);
+  free(expected);
+  region_index_destroy(&index);
+  region_pool_destroy(&pool);
+}
+
+static void fill(image_t *image, int x, int y, int width, int height,
+                 uint8_t shade)
+{
+  for (int row = y; row < y + height; row++)
+  {
+    image_set_span(image, row, x, x + width, shade);
+  }
+}
+
+// Draws a grid of cells, each holding a rectangle with another inside it and
+// at least a pixel of background around each, so the image holds thousands
+// of small nested regions.
+static image_t *generate_image(int width, int height, int cell)
+{
+  image_t *image = NULL;
+  image_error_t err = init_image(&image, width, height, GRAY, 255);
+  if (err)
+  {
+    image_print_error(err);
+    exit(EXIT_FAILURE);
+  }
+  fill(image, 0, 0, width, height, 0);
+  for (int y = 0; y + cell <= height; y += cell)
+  {
+    for (int x = 0; x + cell <= width; x += cell)
+    {
+      const int w = 3 + random_below(cell - 4), h = 3 + random_below(cell - 4);
+      const int ox = x + 1 + random_below(cell - 1 - w);
+      const int oy = y + 1 + random_below(cell - 1 - h);
+      fill(image, ox, oy, w, h, 100);
+      const int iw = 1 + random_below(w - 2), ih = 1 + random_below(h - 2);
+      fill(image, ox + 1 + random_below(w - 1 - iw),
+           oy + 1 + random_below(h - 1 - ih), iw, ih, 200);
+    }
+  }
+  return image;
+}
+
+int main(void)
+{
+  static const char *const images[] = {
+    "../images/input1.pgm", "../images/input2.pgm", "../images/input3.pgm",
+    "../images/input4.pgm", "../images/input5.pgm", "../images/input6.pgm",
+    "../images/input7.pgm"
+  };
+  for (size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++)
+  {
+    image_t *image = NULL;
+    image_error_t err = image_read(images[i], &image);
+    if (err)
+    {
+      image_print_error(err);
+      failures++;
+      continue;
+    }
+    check_pool(images[i], image);
+    image_free(image);
+  }
+
+  image_t *generated = generate_image(1024, 768, 16);
+  check_pool("generated", generated);
+  image_free(generated);
+
+  return check_summary("All region index checks passed");
+}
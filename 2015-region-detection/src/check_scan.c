@@ -0,0 +1,180 @@
+#include "check.h"
+#include "image.h"
+#include "image_fast.h"
+#include "pool.h"
+#include "scan.h"
+#include "typedefs.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// Checks that scan_regions_parallel() finds the same regions as
+// scan_regions(), in the same order, for several thread counts, on the
+// sample images and on generated images whose regions cross the seams
+// between bands in different ways. Run from the src directory, as the images
+// are found through ../images.
+
+static uint64_t seed = 11;
+
+static int random_below(int n)
+{
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (int) ((seed >> 33) % n);
+}
+
+static image_t *blank_image(int width, int height, int channels)
+{
+  image_t *image = NULL;
+  image_error_t err = init_image(&image, width, height, channels, 255);
+  if (err)
+  {
+    image_print_error(err);
+    exit(EXIT_FAILURE);
+  }
+  for (int y = 0; y < height; y++)
+  {
+    image_set_span(image, y, 0, width, 0);
+  }
+  return image;
+}
+
+static void fill(image_t *image, int x, int y, int width, int height,
+                 uint8_t shade)
+{
+  for (int row = y; row < y + height; row++)
+  {
+    image_set_span(image, row, x, x + width, shade);
+  }
+}
+
+// A grid of cells, each holding a rectangle with another inside it, so that
+// every seam cuts through some of thousands of small regions.
+static image_t *generate_cells(int width, int height, int cell)
+{
+  image_t *image = blank_image(width, height, GRAY);
+  for (int y = 0; y + cell <= height; y += cell)
+  {
+    for (int x = 0; x + cell <= width; x += cell)
+    {
+      const int w = 3 + random_below(cell - 4), h = 3 + random_below(cell - 4);
+      const int ox = x + 1 + random_below(cell - 1 - w);
+      const int oy = y + 1 + random_below(cell - 1 - h);
+      fill(image, ox, oy, w, h, 100);
+      const int iw = 1 + random_below(w - 2), ih = 1 + random_below(h - 2);
+      fill(image, ox + 1 + random_below(w - 1 - iw),
+           oy + 1 + random_below(h - 1 - ih), iw, ih, 200);
+    }
+  }
+  return image;
+}
+
+// Concentric rectangles that span every band, with small regions scattered
+// between them, so the open regions at a seam include regions from far above.
+static image_t *generate_nested(int width, int height)
+{
+  image_t *image = blank_image(width, height, GRAY);
+  int depth = 0;
+  for (int inset = 8; 2 * inset < width - 8; inset += 24, depth++)
+  {
+    fill(image, inset, inset, width - 2 * inset, height - 2 * inset,
+         depth % 2 ? 60 : 120);
+  }
+  for (int i = 0; i < 400; i++)
+  {
+    fill(image, random_below(width - 4), random_below(height - 4), 3, 3, 250);
+  }
+  return image;
+}
+
+// Rectangles of random sizes and a few shades drawn over each other, which
+// do not nest at all.
+static image_t *generate_noise(int width, int height, int channels)
+{
+  image_t *image = blank_image(width, height, channels);
+  for (int i = 0; i < 3000; i++)
+  {
+    const int x = random_below(width), y = random_below(height);
+    const int w = 1 + random_below(width - x < 64 ? width - x : 64);
+    const int h = 1 + random_below(height - y < 256 ? height - y : 256);
+    fill(image, x, y, w, h, 50 * random_below(4));
+  }
+  return image;
+}
+
+// Horizontal stripes, some of which end exactly on a seam.
+static image_t *generate_stripes(int width, int height)
+{
+  image_t *image = blank_image(width, height, GRAY);
+  for (int y = 0; y < height; y += 64)
+  {
+    fill(image, 0, y, width, 32, 200);
+    fill(image, width / 4, y + 8, width / 2, 16, 100);
+  }
+  return image;
+}
+
+static void check_image(const char *name, image_t *image)
+{
+  printf("%s (%dx%d)... ", name, image->width, image->height);
+  fflush(stdout);
+
+  region_pool_t expected;
+  region_pool_init(&expected);
+  scan_regions(&expected, image);
+
+  const int before = failures;
+  static const int threads[] = {2, 3, 4, 7, 8};
+  for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+  {
+    region_pool_t found;
+    region_pool_init(&found);
+    scan_regions_parallel(&found, image, threads[t]);
+
+    int same = found.count == expected.count;
+    for (int i = 0; i < found.count && same; i++)
+    {
+      const region_t *r1 = &found.regions[i], *r2 = &expected.regions[i];
+      same = r1->position.x == r2->position.x &&
+             r1->position.y == r2->position.y &&
+             r1->extent.width == r2->extent.width &&
+             r1->extent.height == r2->extent.height &&
+             r1->depth == r2->depth;
+    }
+    check(same, "the parallel scan finds the sequential scan's regions");
+    region_pool_destroy(&found);
+  }
+
+  printf("%s (%d regions)\n", failures == before ? "ok" : "failed",
+         expected.count);
+  region_pool_destroy(&expected);
+  image_free(image);
+}
+
+int main(void)
+{
+  static const char *const images[] = {
+    "../images/input1.pgm", "../images/input2.pgm", "../images/input3.pgm",
+    "../images/input4.pgm", "../images/input5.pgm", "../images/input6.pgm",
+    "../images/input7.pgm"
+  };
+  for (size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++)
+  {
+    image_t *image = NULL;
+    image_error_t err = image_read(images[i], &image);
+    if (err)
+    {
+      image_print_error(err);
+      failures++;
+      continue;
+    }
+    check_image(images[i], image);
+  }
+
+  check_image("cells", generate_cells(640, 2048, 16));
+  check_image("nested", generate_nested(512, 2304));
+  check_image("noise", generate_noise(800, 1600, GRAY));
+  check_image("noise, RGB", generate_noise(300, 1100, RGB));
+  check_image("stripes", generate_stripes(256, 2048));
+
+  return check_summary("All scan_regions_parallel() checks passed");
+}
@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "image.h"
+#include "image_fast.h"
+#include "image_map.h"
+#include "region.h"
+#include "pool.h"
+#include "typedefs.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Generates a PGM image of nested rectangles, together with the regions.txt
+// that find_regions() should produce for it. Every region is split into a
+// grid of about "branching" cells, most of which get a child placed at random
+// within the cell, down to the maximum depth. A child is always at least one
+// pixel inside its parent and apart from its siblings and differs in shade
+// from its parent, so the expected regions are exactly the ones drawn.
+
+typedef struct
+{
+  image_t *image;
+  region_pool_t *regions;
+  int max_depth;
+  int branching;
+  long max_regions;
+  long count;
+  int skewed;
+  uint64_t rng;
+} generator_t;
+
+// Spreads a seed over the xorshift state with the splitmix64 finalizer, so
+// every seed gives a different sequence. Only the one seed mapping to the
+// state 0, which xorshift never leaves, is moved to another state.
+static uint64_t random_state(uint64_t seed)
+{
+  uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  return z ? z : 0x9e3779b97f4a7c15ULL;
+}
+
+static uint32_t random_next(generator_t *g)
+{
+  g->rng ^= g->rng << 13;
+  g->rng ^= g->rng >> 7;
+  g->rng ^= g->rng << 17;
+  return g->rng >> 32;
+}
+
+// Returns a random integer in [0, n).
+static int random_below(generator_t *g, int n)
+{
+  return random_next(g) % n;
+}
+
+// Returns a child size between 1 and "space": uniform, or skewed so that
+// most children are small.
+static int random_size(generator_t *g, int space)
+{
+  if (!g->skewed)
+  {
+    return 1 + random_below(g, space);
+  }
+  double u = random_next(g) / 4294967296.0;
+  return 1 + (int) ((space - 1) * u * u * u);
+}
+
+// Draws a region of the given shade and recurses into a grid of children.
+static void generate(generator_t *g, int x0, int y0, int width, int height,
+                     int depth, uint8_t shade)
+{
+  region_pool_add(g->regions, x0, y0, width, height, depth);
+  g->count++;
+
+  for (int y = y0; y < y0 + height; y++)
+  {
+    image_set_span(g->image, y, x0, x0 + width, shade);
+  }
+
+  if (depth == g->max_depth)
+  {
+    return;
+  }
+
+  // cells tile the interior, inside a one pixel border of this region; each
+  // keeps its last row and column clear to separate neighbouring children
+  int inner_width = width - 2, inner_height = height - 2;
+  int cells = (int) ceil(sqrt(g->branching));
+  while (cells > 1 &&
+         (inner_width / cells < 2 || inner_height / cells < 2))
+  {
+    cells--;
+  }
+  int cell_width = inner_width / cells, cell_height = inner_height / cells;
+  if (cell_width < 2 || cell_height < 2)
+  {
+    return;
+  }
+
+  for (int cy = 0; cy < cells; cy++)
+  {
+    for (int cx = 0; cx < cells; cx++)
+    {
+      if (g->max_regions > 0 && g->count >= g->max_regions)
+      {
+        return;
+      }
+      if (random_below(g, 4) == 0)
+      {
+        continue;
+      }
+
+      int space_x = cell_width - 1, space_y = cell_height - 1;
+      int w = random_size(g, space_x), h = random_size(g, space_y);
+      int x = x0 + 1 + cx * cell_width + random_below(g, space_x - w + 1);
+      int y = y0 + 1 + cy * cell_height + random_below(g, space_y - h + 1);
+
+      uint8_t child_shade = random_below(g, 255);
+      if (child_shade >= shade)
+      {
+        child_shade++;
+      }
+      generate(g, x, y, w, h, depth + 1, child_shade);
+    }
+  }
+}
+
+static void usage(const char *program)
+{
+  fprintf(stderr, "Usage: %s [-w width] [-h height] [-d depth] "
+          "[-b branching] [-n regions]\n"
+          "          [-z] [-s seed] -o image.pgm [-t regions.txt]\n",
+          program);
+  fprintf(stderr, "  -d  maximum nesting depth (default 4)\n"
+          "  -b  children tried per region (default 16)\n"
+          "  -n  stop after this many regions (default no limit)\n"
+          "  -z  skew child sizes towards small regions\n");
+}
+
+int main(int argc, char **argv)
+{
+  int width = 2048, height = 2048;
+  const char *image_file = NULL, *text_file = NULL;
+  generator_t g = {NULL, NULL, 4, 16, 0, 0, 0, 1};
+  int opt;
+
+  while ((opt = getopt(argc, argv, "w:h:d:b:n:zs:o:t:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'w': width = atoi(optarg); break;
+      case 'h': height = atoi(optarg); break;
+      case 'd': g.max_depth = atoi(optarg); break;
+      case 'b': g.branching = atoi(optarg); break;
+      case 'n': g.max_regions = atol(optarg); break;
+      case 'z': g.skewed = 1; break;
+      case 's': g.rng = random_state(strtoull(optarg, NULL, 10)); break;
+      case 'o': image_file = optarg; break;
+      case 't': text_file = optarg; break;
+      default: usage(argv[0]); return EXIT_FAILURE;
+    }
+  }
+  if (image_file == NULL || width < 1 || height < 1 || g.max_depth < 0 ||
+      g.branching < 1)
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  image_error_t img_err = image_map_create(image_file, &g.image, width,
+                                           height, PGM_FORMAT);
+  if (img_err)
+  {
+    image_print_error(img_err);
+    return EXIT_FAILURE;
+  }
+
+  region_pool_t regions;
+  region_pool_init(&regions);
+  g.regions = &regions;
+  generate(&g, 0, 0, width, height, 0, random_below(&g, 256));
+
+  img_err = image_unmap(g.image);
+  if (img_err)
+  {
+    image_print_error(img_err);
+    return EXIT_FAILURE;
+  }
+
+  if (text_file != NULL)
+  {
+    FILE *text_out = fopen(text_file, "w");
+    if (text_out == NULL)
+    {
+      perror(text_file);
+      return EXIT_FAILURE;
+    }
+    region_pool_sort(&regions);
+    region_pool_print(text_out, &regions);
+    fclose(text_out);
+  }
+
+  fprintf(stderr, "%s: %dx%d, %ld regions\n", image_file, width, height,
+          g.count);
+  region_pool_destroy(&regions);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+#ifndef IMAGE_FAST_H_
+#define IMAGE_FAST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "image.h"
+
+/*
+ * Unchecked accessors for inner loops. Unlike get_pixel and set_pixel these
+ * are inlined and do not check their arguments: the caller must ensure that
+ * 0 <= x < width and 0 <= y < height. A row-span is the pixels [x0, x1) of
+ * one row.
+ */
+static inline uint8_t *image_row(const image_t *image, int y)
+{
+  return image->pixelsData + (size_t) y * image->widthStep;
+}
+
+static inline uint8_t get_pixel_fast(const image_t *src, int x, int y)
+{
+  return image_row(src, y)[x * src->nChannels];
+}
+
+static inline void set_pixel_fast(image_t *dst, int x, int y, uint8_t value)
+{
+  image_row(dst, y)[x * dst->nChannels] = value;
+}
+
+static inline void image_set_span(image_t *dst, int y, int x0, int x1,
+                                  uint8_t value)
+{
+  uint8_t *row = image_row(dst, y);
+  const int step = dst->nChannels;
+  if (step == 1)
+  {
+    // contiguous pixels: let the C library's vectorised fill do the work
+    if (x1 > x0)
+    {
+      memset(row + x0, value, x1 - x0);
+    }
+    return;
+  }
+  for (int x = x0; x < x1; x++)
+  {
+    row[x * step] = value;
+  }
+}
+
+#endif
@@ -0,0 +1,256 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "image.h"
+#include "image_map.h"
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * An image whose pixels live in a memory-mapped file. The image comes first so
+ * that the image_t * handed out can be converted back.
+ */
+typedef struct
+{
+  image_t image;
+  void *map;
+  size_t length;
+  int fd;
+} mapped_image_t;
+
+/*
+ * Skips whitespace and comments in the header at *p, stopping at end.
+ */
+static void map_skip_separators(const char **p, const char *end)
+{
+  while (*p < end)
+  {
+    if (**p == '#')
+    {
+      while (*p < end && **p != '\n')
+      {
+        (*p)++;
+      }
+    }
+    else if (isspace((unsigned char) **p))
+    {
+      (*p)++;
+    }
+    else
+    {
+      return;
+    }
+  }
+}
+
+/*
+ * Parses a non-negative decimal header field at *p. Returns 1 on success,
+ * otherwise 0.
+ */
+static int map_read_field(const char **p, const char *end, int *value)
+{
+  map_skip_separators(p, end);
+  if (*p == end || !isdigit((unsigned char) **p))
+  {
+    return 0;
+  }
+
+  long v = 0;
+  while (*p < end && isdigit((unsigned char) **p))
+  {
+    v = 10 * v + (**p - '0');
+    if (v > INT_MAX)
+    {
+      return 0;
+    }
+    (*p)++;
+  }
+  *value = v;
+  return 1;
+}
+
+/*
+ * Attempts to map a PGM or PPM image stored in P5 or P6 format from the given
+ * file. The header is parsed in place and pixelsData points into the mapping,
+ * so no pixel is copied or read until it is used.
+ * Returns IMG_OK on success or an appropriate error code on failure. The
+ * parameter out will contain the mapped image if and only if the return value
+ * is IMG_OK.
+ */
+image_error_t image_map_read(const char *filename, image_t **out)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+  {
+    return IMG_OPEN_FAILURE;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < 2)
+  {
+    close(fd);
+    return IMG_MISSING_FORMAT;
+  }
+
+  size_t length = st.st_size;
+  void *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    return IMG_INSUFFICIENT_MEMORY;
+  }
+
+  const char *p = map, *end = p + length;
+  image_error_t error = IMG_OK;
+  int width = 0, height = 0, depth = 0, nChannels = 0;
+
+  if (p[0] != 'P' || (p[1] != '5' && p[1] != '6'))
+  {
+    error = IMG_INVALID_FORMAT;
+  }
+  else
+  {
+    nChannels = p[1] == '5' ? GRAY : RGB;
+    p += 2;
+    if (!map_read_field(&p, end, &width) || !map_read_field(&p, end, &height))
+    {
+      error = IMG_INVALID_SIZE;
+    }
+    else if (!map_read_field(&p, end, &depth) || depth != DEPTH)
+    {
+      error = IMG_INVALID_DEPTH;
+    }
+    // a single whitespace character separates the header from the raster
+    else if (p == end || !isspace((unsigned char) *p++) ||
+             (size_t) (end - p) / nChannels / (width ? width : 1) <
+             (size_t) height)
+    {
+      error = IMG_READ_FAILURE;
+    }
+  }
+
+  mapped_image_t *mapped = NULL;
+  if (error == IMG_OK && (mapped = malloc(sizeof(mapped_image_t))) == NULL)
+  {
+    error = IMG_INSUFFICIENT_MEMORY;
+  }
+  if (error != IMG_OK)
+  {
+    munmap(map, length);
+    return error;
+  }
+
+  image_t *image = &mapped->image;
+  image->width = width;
+  image->height = height;
+  image->nChannels = nChannels;
+  image->widthStep = nChannels * width;
+  image->depth = depth;
+  image->pixelsData = (uint8_t *) p;
+  mapped->map = map;
+  mapped->length = length;
+  mapped->fd = -1;
+
+  // detection reads the raster front to back
+  posix_madvise(map, length, POSIX_MADV_SEQUENTIAL);
+
+  *out = image;
+  return IMG_OK;
+}
+
+/*
+ * Creates the given file as a P5 (PGM_FORMAT) or P6 (PPM_FORMAT) image of the
+ * given size, zero filled, and maps it. Pixels set in the image are written
+ * to the file when it is passed to image_unmap.
+ * Returns IMG_OK on success or an appropriate error code on failure. The
+ * parameter out will contain the mapped image if and only if the return value
+ * is IMG_OK.
+ */
+image_error_t image_map_create(const char *filename, image_t **out,
+                               int width, int height, imageformat format)
+{
+  if (format != PGM_FORMAT && format != PPM_FORMAT)
+  {
+    return IMG_INVALID_FORMAT;
+  }
+  if (width < 0 || height < 0)
+  {
+    return IMG_INVALID_SIZE;
+  }
+
+  int nChannels = format == PGM_FORMAT ? GRAY : RGB;
+  char header[64];
+  int header_length = snprintf(header, sizeof(header), "P%c\n%d %d\n%d\n",
+                               format == PGM_FORMAT ? '5' : '6',
+                               width, height, DEPTH);
+  size_t length = header_length + (size_t) nChannels * width * height;
+
+  mapped_image_t *mapped = malloc(sizeof(mapped_image_t));
+  if (mapped == NULL)
+  {
+    return IMG_INSUFFICIENT_MEMORY;
+  }
+
+  mapped->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (mapped->fd < 0)
+  {
+    free(mapped);
+    return IMG_OPEN_FAILURE;
+  }
+
+  // reserve the whole file up front; the raster reads back as zeros
+  mapped->map = MAP_FAILED;
+  if (ftruncate(mapped->fd, length) == 0)
+  {
+    mapped->map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       mapped->fd, 0);
+  }
+  if (mapped->map == MAP_FAILED)
+  {
+    close(mapped->fd);
+    free(mapped);
+    return IMG_WRITE_FAILURE;
+  }
+  mapped->length = length;
+  memcpy(mapped->map, header, header_length);
+
+  image_t *image = &mapped->image;
+  image->width = width;
+  image->height = height;
+  image->nChannels = nChannels;
+  image->widthStep = nChannels * width;
+  image->depth = DEPTH;
+  image->pixelsData = (uint8_t *) mapped->map + header_length;
+
+  *out = image;
+  return IMG_OK;
+}
+
+/*
+ * Releases an image from image_map_read or image_map_create, completing the
+ * file of the latter. Returns IMG_OK on success or IMG_WRITE_FAILURE if a
+ * created file could not be written.
+ */
+image_error_t image_unmap(image_t *image)
+{
+  mapped_image_t *mapped = (mapped_image_t *) image;
+  image_error_t error = IMG_OK;
+
+  if (munmap(mapped->map, mapped->length) < 0)
+  {
+    error = IMG_WRITE_FAILURE;
+  }
+  if (mapped->fd >= 0 && close(mapped->fd) < 0)
+  {
+    error = IMG_WRITE_FAILURE;
+  }
+  free(mapped);
+  return error;
+}
@@ -0,0 +1,18 @@
+#ifndef IMAGE_MAP_H_
+#define IMAGE_MAP_H_
+
+#include "image.h"
+
+/*
+ * Memory-mapped image I/O. image_map_read maps a P5 or P6 file and points
+ * pixelsData straight at its raster; the mapping is private, so the pixels
+ * may be changed without touching the file. image_map_create sizes and maps
+ * a new P5 or P6 file so that pixels written to the image land directly in
+ * it. Images from either must be released with image_unmap, not image_free.
+ */
+image_error_t image_map_read(const char *filename, image_t **image_ptr);
+image_error_t image_map_create(const char *filename, image_t **image_ptr,
+                               int width, int height, imageformat format);
+image_error_t image_unmap(image_t *image);
+
+#endif
@@ -0,0 +1,141 @@
+#include "integral.h"
+#include "image.h"
+#include "image_fast.h"
+#include "typedefs.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+void integral_init(integral_t *table, const image_t *image)
+{
+  table->cells = NULL;
+  table->capacity = 0;
+  integral_update(table, image);
+}
+
+void integral_update(integral_t *table, const image_t *image)
+{
+  const int width = image->width, height = image->height;
+  const size_t stride = width + 1;
+  const int step = image->nChannels;
+
+  table->width = width;
+  table->height = height;
+  if (stride * (height + 1) > table->capacity)
+  {
+    free(table->cells);
+    table->capacity = stride * (height + 1);
+    table->cells = malloc(table->capacity * sizeof(integral_cell_t));
+    if (table->cells == NULL)
+    {
+      perror("integral_update");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memset(table->cells, 0, stride * sizeof(integral_cell_t));
+
+  // each cell is the one above plus the running totals of its row
+  for (int y = 0; y < height; y++)
+  {
+    const uint8_t *row = image_row(image, y);
+    const integral_cell_t *above = table->cells + y * stride;
+    integral_cell_t *cell = table->cells + (y + 1) * stride;
+    uint64_t sum = 0, sum_sq = 0;
+
+    cell[0].sum = cell[0].sum_sq = 0;
+    for (int x = 0; x < width; x++)
+    {
+      const uint32_t p = row[x * step];
+      sum += p;
+      sum_sq += p * p;
+      cell[x + 1].sum = above[x + 1].sum + sum;
+      cell[x + 1].sum_sq = above[x + 1].sum_sq + sum_sq;
+    }
+  }
+}
+
+void integral_destroy(integral_t *table)
+{
+  free(table->cells);
+  table->cells = NULL;
+  table->capacity = 0;
+}
+
+// Returns 1 if every pixel of the width x height rectangle at (x, y) that
+// lies outside the "count" regions in "holes" has shade "shade", otherwise 0.
+static int uniform_outside(const integral_t *table, int x, int y, int width,
+                           int height, const region_t *const *holes,
+                           int count, uint8_t shade)
+{
+  integral_cell_t totals = integral_rect(table, x, y, width, height);
+  uint64_t n = (uint64_t) width * height;
+  for (int i = 0; i < count; i++)
+  {
+    // the part of the hole inside the rectangle
+    const region_t *hole = holes[i];
+    const int hx1 = hole->position.x + hole->extent.width;
+    const int hy1 = hole->position.y + hole->extent.height;
+    const int x0 = hole->position.x > x ? hole->position.x : x;
+    const int y0 = hole->position.y > y ? hole->position.y : y;
+    const int x1 = hx1 < x + width ? hx1 : x + width;
+    const int y1 = hy1 < y + height ? hy1 : y + height;
+    if (x0 < x1 && y0 < y1)
+    {
+      const integral_cell_t covered = integral_rect(table, x0, y0, x1 - x0,
+                                                    y1 - y0);
+      totals.sum -= covered.sum;
+      totals.sum_sq -= covered.sum_sq;
+      n -= (uint64_t) (x1 - x0) * (y1 - y0);
+    }
+  }
+  return integral_totals_uniform(totals, n, shade);
+}
+
+// Returns the number of leading rows (or, if "by_rows" is 0, columns) of the
+// rectangle whose pixels outside the holes are all of shade "shade", by
+// bisection.
+static int uniform_prefix(const integral_t *table, int x, int y, int width,
+                          int height, const region_t *const *holes,
+                          int count, uint8_t shade, int by_rows)
+{
+  int lo = 0, hi = by_rows ? height : width;
+  while (lo < hi)
+  {
+    const int mid = lo + (hi - lo + 1) / 2;
+    const int uniform = by_rows
+        ? uniform_outside(table, x, y, width, mid, holes, count, shade)
+        : uniform_outside(table, x, y, mid, height, holes, count, shade);
+    if (uniform)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+int integral_find_mismatch(const integral_t *table, const region_t *area,
+                           const region_t *const *holes, int count,
+                           uint8_t shade, point_t *at)
+{
+  const int x = area->position.x, y = area->position.y;
+  const int width = area->extent.width, height = area->extent.height;
+  if (width <= 0 || height <= 0 ||
+      uniform_outside(table, x, y, width, height, holes, count, shade))
+  {
+    return 0;
+  }
+
+  // the first row that is not all "shade", then the first pixel along it
+  const int rows = uniform_prefix(table, x, y, width, height, holes, count,
+                                  shade, 1);
+  const int columns = uniform_prefix(table, x, y + rows, width, 1, holes,
+                                     count, shade, 0);
+  at->x = x + columns;
+  at->y = y + rows;
+  return 1;
+}
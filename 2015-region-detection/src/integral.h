@@ -0,0 +1,88 @@
+#ifndef _INTEGRAL_H_
+#define _INTEGRAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "image.h"
+#include "typedefs.h"
+
+// Summed-area tables of an image's pixels and of their squares, which answer
+// "is this rectangle a single shade?" in constant time: a rectangle of n
+// pixels is all of shade s exactly when its pixels sum to n * s and their
+// squares to n * s * s, as its variance is then zero. The tables take 16
+// bytes per pixel, so they are built only where many rectangles are to be
+// tested.
+
+// The totals of the pixels, and of their squares, of some rectangle.
+typedef struct integral_cell
+{
+  uint64_t sum, sum_sq;
+} integral_cell_t;
+
+// cells[y * (width + 1) + x] holds the totals of the pixels above and to the
+// left of (x, y); row 0 and column 0 are zero.
+typedef struct integral
+{
+  int width, height;
+  integral_cell_t *cells;
+  size_t capacity;
+} integral_t;
+
+// Builds the tables for the first channel of "image".
+void integral_init(integral_t *table, const image_t *image);
+
+// Rebuilds the tables for the first channel of "image", which may differ in
+// size from the last, reusing their storage when it is large enough. A
+// zeroed integral_t is an empty table that this may also be given.
+void integral_update(integral_t *table, const image_t *image);
+
+// Frees the tables.
+void integral_destroy(integral_t *table);
+
+// Returns the totals of the width x height rectangle at (x, y), which must
+// lie within the image.
+static inline integral_cell_t integral_rect(const integral_t *table, int x,
+                                            int y, int width, int height)
+{
+  const size_t stride = table->width + 1;
+  const integral_cell_t *top = table->cells + y * stride + x;
+  const integral_cell_t *bottom = top + height * stride;
+  integral_cell_t c;
+  c.sum = bottom[width].sum - bottom[0].sum - top[width].sum + top[0].sum;
+  c.sum_sq = bottom[width].sum_sq - bottom[0].sum_sq - top[width].sum_sq +
+             top[0].sum_sq;
+  return c;
+}
+
+// Returns 1 if "totals" are those of "n" pixels that all have shade "shade",
+// otherwise 0.
+static inline int integral_totals_uniform(integral_cell_t totals, uint64_t n,
+                                          uint8_t shade)
+{
+  return totals.sum == n * shade && totals.sum_sq == n * shade * shade;
+}
+
+// Returns 1 if every pixel of the width x height rectangle at (x, y) has
+// shade "shade", otherwise 0.
+static inline int integral_uniform(const integral_t *table, int x, int y,
+                                   int width, int height, uint8_t shade)
+{
+  return integral_totals_uniform(integral_rect(table, x, y, width, height),
+                                 (uint64_t) width * height, shade);
+}
+
+// Returns the shade of the pixel at (x, y).
+static inline uint8_t integral_pixel(const integral_t *table, int x, int y)
+{
+  return (uint8_t) integral_rect(table, x, y, 1, 1).sum;
+}
+
+// Finds the first pixel, in [y, x] order, of region "area" that lies outside
+// the "count" disjoint regions in "holes" and is not of shade "shade", using
+// O(count * (log(width) + log(height))) table lookups. Returns 1 and sets
+// "at" to it if there is one, otherwise returns 0.
+int integral_find_mismatch(const integral_t *table, const region_t *area,
+                           const region_t *const *holes, int count,
+                           uint8_t shade, point_t *at);
+
+#endif
@@ -0,0 +1,447 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "label.h"
+#include "region.h"
+#include "image.h"
+#include "image_fast.h"
+#include "typedefs.h"
+#include "scan.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// What is known of the pixels given one provisional label.
+typedef struct label_stats {
+  int x0, y0, x1, y1;
+  long area;
+  uint8_t shade;
+} label_stats_t;
+
+// A band of rows labelled by one thread. Its provisional labels are numbered
+// from 0 and become offset + label once the bands are joined. Each label is
+// a node of a union-find forest whose root is the smallest label of its
+// component, which is the label of the component's first run.
+typedef struct label_band {
+  const image_t *image;
+  int y0, y1;
+  int offset;
+
+  int *parent;
+  label_stats_t *stats;
+  int count, capacity;
+
+  // pairs of labels of runs of different shades that touch
+  int *edges;
+  size_t edge_count, edge_capacity;
+
+  // the runs of the band's first and last rows, and their labels, for
+  // joining the band to its neighbours
+  scan_run_t *first_runs, *last_runs, *runs;
+  int *first_labels, *last_labels, *labels;
+  int first_count, last_count;
+} label_band_t;
+
+static void *grow(void *p, size_t size, const char *what) {
+  p = realloc(p, size);
+  if (p == NULL) {
+    perror(what);
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+// Returns the root of "label", halving the path to it.
+static int find(int *parent, int label) {
+  while (parent[label] != label) {
+    parent[label] = parent[parent[label]];
+    label = parent[label];
+  }
+  return label;
+}
+
+// Joins the sets of "a" and "b" under the smaller root, and returns it.
+static int join(int *parent, int a, int b) {
+  a = find(parent, a);
+  b = find(parent, b);
+  if (a < b) {
+    parent[b] = a;
+    return a;
+  }
+  parent[a] = b;
+  return b;
+}
+
+static void add_edge(label_band_t *band, int a, int b) {
+  if (band->edge_count + 2 > band->edge_capacity) {
+    band->edge_capacity = 2 * band->edge_capacity + 64;
+    band->edges = grow(band->edges, band->edge_capacity * sizeof(int),
+                       "add_edge");
+  }
+  band->edges[band->edge_count++] = a;
+  band->edges[band->edge_count++] = b;
+}
+
+static int new_label(label_band_t *band, uint8_t shade) {
+  if (band->count == band->capacity) {
+    band->capacity = 2 * band->capacity + 64;
+    band->parent = grow(band->parent, band->capacity * sizeof(int),
+                        "new_label");
+    band->stats = grow(band->stats, band->capacity * sizeof(label_stats_t),
+                       "new_label");
+  }
+  const int label = band->count++;
+  band->parent[label] = label;
+  band->stats[label].x0 = INT32_MAX;
+  band->stats[label].y0 = INT32_MAX;
+  band->stats[label].x1 = band->stats[label].y1 = 0;
+  band->stats[label].area = 0;
+  band->stats[label].shade = shade;
+  return label;
+}
+
+// Returns the x just past run i of a row of "count" runs.
+static inline int run_end(const scan_run_t *runs, int count, int i,
+                          int width) {
+  return i + 1 < count ? runs[i + 1].x : width;
+}
+
+// Labels the runs of one row, given the runs and labels of the row above
+// (none for the band's first row).
+static void label_row(label_band_t *band, int y, const scan_run_t *above,
+                      const int *above_labels, int above_count,
+                      const scan_run_t *runs, int *labels, int count) {
+  const int width = band->image->width;
+  for (int r = 0; r < count; r++) {
+    labels[r] = -1;
+  }
+
+  // join each run to the runs of its shade above it, and record the pairs
+  // of shades that meet; the runs of both rows are in x order, so one pass
+  // visits every pair that share a column
+  for (int i = 0, j = 0; i < above_count && j < count;) {
+    if (above[i].shade != runs[j].shade) {
+      add_edge(band, above_labels[i], labels[j] >= 0 ? labels[j] : -1 - j);
+    } else if (labels[j] < 0) {
+      labels[j] = find(band->parent, above_labels[i]);
+    } else {
+      labels[j] = join(band->parent, labels[j], above_labels[i]);
+    }
+    const int end_above = run_end(above, above_count, i, width);
+    const int end = run_end(runs, count, j, width);
+    i += end_above <= end;
+    j += end <= end_above;
+  }
+
+  for (int r = 0; r < count; r++) {
+    if (labels[r] < 0) {
+      labels[r] = new_label(band, runs[r].shade);
+    }
+    const int x0 = runs[r].x;
+    const int x1 = run_end(runs, count, r, width);
+    label_stats_t *s = &band->stats[labels[r]];
+    if (x0 < s->x0) {
+      s->x0 = x0;
+    }
+    if (x1 > s->x1) {
+      s->x1 = x1;
+    }
+    if (y < s->y0) {
+      s->y0 = y;
+    }
+    s->y1 = y + 1;
+    s->area += x1 - x0;
+    if (r > 0) {
+      add_edge(band, labels[r - 1], labels[r]);
+    }
+  }
+}
+
+// Replaces the placeholders that label_row() records, for runs that had no
+// label yet when an edge to them was found, with the runs' labels. Only the
+// edges added for the latest row can hold them.
+static void fix_edges(label_band_t *band, size_t from, const int *labels) {
+  for (size_t e = from; e < band->edge_count; e++) {
+    if (band->edges[e] < 0) {
+      band->edges[e] = labels[-1 - band->edges[e]];
+    }
+  }
+}
+
+static void *label_band(void *arg) {
+  label_band_t *band = arg;
+  const image_t *image = band->image;
+  const int width = image->width;
+  int *above_labels = grow(NULL, (width + 1) * sizeof(int), "label_band");
+  scan_run_t *above = grow(NULL, (width + 1) * sizeof(scan_run_t),
+                           "label_band");
+  band->runs = grow(NULL, (width + 1) * sizeof(scan_run_t), "label_band");
+  band->labels = grow(NULL, (width + 1) * sizeof(int), "label_band");
+  int above_count = 0;
+
+  for (int y = band->y0; y < band->y1; y++) {
+    const int count = scan_encode_row(band->runs, image_row(image, y), width,
+                                      image->nChannels);
+    const size_t edges = band->edge_count;
+    label_row(band, y, above, above_labels, above_count, band->runs,
+              band->labels, count);
+    fix_edges(band, edges, band->labels);
+
+    if (y == band->y0) {
+      band->first_runs = grow(NULL, (count + 1) * sizeof(scan_run_t),
+                              "label_band");
+      band->first_labels = grow(NULL, (count + 1) * sizeof(int),
+                                "label_band");
+      memcpy(band->first_runs, band->runs, count * sizeof(scan_run_t));
+      memcpy(band->first_labels, band->labels, count * sizeof(int));
+      band->first_count = count;
+    }
+
+    scan_run_t *tmp_runs = above;
+    above = band->runs;
+    band->runs = tmp_runs;
+    int *tmp_labels = above_labels;
+    above_labels = band->labels;
+    band->labels = tmp_labels;
+    above_count = count;
+  }
+
+  // the row above the next band is this band's last
+  band->last_runs = above;
+  band->last_labels = above_labels;
+  band->last_count = above_count;
+  return NULL;
+}
+
+// Joins the labels of the bands, which are numbered in order, into one
+// forest and resolves it into components, numbered by their first pixels.
+static void resolve(component_set_t *set, label_band_t *bands, int count,
+                    int width, int height) {
+  int total = 0;
+  size_t edge_total = 0;
+  for (int t = 0; t < count; t++) {
+    bands[t].offset = total;
+    total += bands[t].count;
+    edge_total += bands[t].edge_count;
+  }
+
+  int *parent = grow(NULL, total * sizeof(int), "label_components");
+  label_stats_t *stats = grow(NULL, total * sizeof(label_stats_t),
+                              "label_components");
+  int *edges = grow(NULL, (edge_total + 2 * (size_t) width * count + 2) *
+                    sizeof(int), "label_components");
+  size_t edge_count = 0;
+  for (int t = 0; t < count; t++) {
+    const label_band_t *band = &bands[t];
+    for (int i = 0; i < band->count; i++) {
+      parent[band->offset + i] = band->offset + band->parent[i];
+    }
+    memcpy(stats + band->offset, band->stats,
+           band->count * sizeof(label_stats_t));
+    for (size_t e = 0; e < band->edge_count; e++) {
+      edges[edge_count++] = band->offset + band->edges[e];
+    }
+  }
+
+  // join the runs that meet across each border between bands
+  for (int t = 1; t < count; t++) {
+    const label_band_t *up = &bands[t - 1], *down = &bands[t];
+    if (up->y0 == up->y1 || down->y0 == down->y1) {
+      continue;
+    }
+    for (int i = 0, j = 0; i < up->last_count && j < down->first_count;) {
+      const int a = up->offset + up->last_labels[i];
+      const int b = down->offset + down->first_labels[j];
+      if (up->last_runs[i].shade == down->first_runs[j].shade) {
+        join(parent, a, b);
+      } else {
+        edges[edge_count++] = a;
+        edges[edge_count++] = b;
+      }
+      const int end_up = run_end(up->last_runs, up->last_count, i, width);
+      const int end_down = run_end(down->first_runs, down->first_count, j,
+                                   width);
+      i += end_up <= end_down;
+      j += end_down <= end_up;
+    }
+  }
+
+  // every label's root is its smallest, so roots come before the rest of
+  // their components and are numbered in the order of their first runs
+  int *ids = grow(NULL, total * sizeof(int), "label_components");
+  set->components = grow(NULL, total * sizeof(component_t) + 1,
+                         "label_components");
+  set->count = 0;
+  for (int i = 0; i < total; i++) {
+    const int root = find(parent, i);
+    const label_stats_t *s = &stats[i];
+    if (root == i) {
+      component_t *c = &set->components[set->count];
+      ids[i] = set->count++;
+      init_point(&c->region.position, s->x0, s->y0);
+      init_extent(&c->region.extent, s->x1, s->y1);
+      c->region.depth = -1;
+      c->area = s->area;
+      c->shade = s->shade;
+      continue;
+    }
+    component_t *c = &set->components[ids[root]];
+    ids[i] = ids[root];
+    if (s->x0 < c->region.position.x) {
+      c->region.position.x = s->x0;
+    }
+    if (s->y0 < c->region.position.y) {
+      c->region.position.y = s->y0;
+    }
+    if (s->x1 > c->region.extent.width) {
+      c->region.extent.width = s->x1;
+    }
+    if (s->y1 > c->region.extent.height) {
+      c->region.extent.height = s->y1;
+    }
+    c->area += s->area;
+  }
+  free(parent);
+  free(stats);
+
+  // extents were gathered as right and bottom edges
+  const int n = set->count;
+  for (int i = 0; i < n; i++) {
+    region_t *r = &set->components[i].region;
+    r->extent.width -= r->position.x;
+    r->extent.height -= r->position.y;
+  }
+
+  // the components that meet, as adjacency lists
+  int *starts = calloc(n + 1, sizeof(int));
+  int *adjacent = grow(NULL, edge_count * sizeof(int) + 1,
+                       "label_components");
+  if (starts == NULL) {
+    perror("label_components");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t e = 0; e < edge_count; e++) {
+    edges[e] = ids[edges[e]];
+    starts[edges[e] + 1]++;
+  }
+  for (int i = 0; i < n; i++) {
+    starts[i + 1] += starts[i];
+  }
+  int *fill = grow(NULL, (n + 1) * sizeof(int), "label_components");
+  memcpy(fill, starts, (n + 1) * sizeof(int));
+  for (size_t e = 0; e < edge_count; e += 2) {
+    adjacent[fill[edges[e]]++] = edges[e + 1];
+    adjacent[fill[edges[e + 1]]++] = edges[e];
+  }
+
+  // a breadth first search from the components on the edge of the image
+  // gives each component its depth
+  int *queue = fill, head = 0, tail = 0;
+  for (int i = 0; i < n; i++) {
+    region_t *r = &set->components[i].region;
+    if (r->position.x == 0 || r->position.y == 0 ||
+        r->position.x + r->extent.width == width ||
+        r->position.y + r->extent.height == height) {
+      r->depth = 0;
+      queue[tail++] = i;
+    }
+  }
+  while (head < tail) {
+    const int c = queue[head++];
+    const int depth = set->components[c].region.depth + 1;
+    for (int k = starts[c]; k < starts[c + 1]; k++) {
+      region_t *r = &set->components[adjacent[k]].region;
+      if (r->depth < 0) {
+        r->depth = depth;
+        queue[tail++] = adjacent[k];
+      }
+    }
+  }
+
+  free(ids);
+  free(edges);
+  free(starts);
+  free(adjacent);
+  free(fill);
+}
+
+static void free_band(label_band_t *band) {
+  free(band->parent);
+  free(band->stats);
+  free(band->edges);
+  free(band->first_runs);
+  free(band->first_labels);
+  free(band->last_runs);
+  free(band->last_labels);
+  free(band->runs);
+  free(band->labels);
+}
+
+void label_components(component_set_t *set, const image_t *image) {
+  label_components_parallel(set, image, 1);
+}
+
+void label_components_parallel(component_set_t *set, const image_t *image,
+                               int threads) {
+  if (threads <= 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? online : 1;
+  }
+  if (threads > image->height) {
+    threads = image->height > 0 ? image->height : 1;
+  }
+
+  label_band_t *bands = calloc(threads, sizeof(label_band_t));
+  pthread_t *ids = malloc(threads * sizeof(pthread_t));
+  if (bands == NULL || ids == NULL) {
+    perror("label_components");
+    exit(EXIT_FAILURE);
+  }
+  for (int t = 0; t < threads; t++) {
+    bands[t].image = image;
+    bands[t].y0 = (long) image->height * t / threads;
+    bands[t].y1 = (long) image->height * (t + 1) / threads;
+  }
+
+  // the calling thread labels the first band itself
+  for (int t = 1; t < threads; t++) {
+    if (pthread_create(&ids[t], NULL, label_band, &bands[t])) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  label_band(&bands[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(ids[t], NULL);
+  }
+
+  resolve(set, bands, threads, image->width, image->height);
+
+  for (int t = 0; t < threads; t++) {
+    free_band(&bands[t]);
+  }
+  free(bands);
+  free(ids);
+}
+
+void print_components(FILE *out, const component_set_t *set, int with_area) {
+  for (int i = 0; i < set->count; i++) {
+    const component_t *c = &set->components[i];
+    if (with_area) {
+      fprintf(out, "Region of depth %i at (%i, %i) of extent (%i, %i) "
+              "and area %ld\n", c->region.depth, c->region.position.x,
+              c->region.position.y, c->region.extent.width,
+              c->region.extent.height, c->area);
+    } else {
+      print_region(out, &c->region);
+    }
+  }
+}
+
+void component_set_destroy(component_set_t *set) {
+  free(set->components);
+  set->components = NULL;
+  set->count = 0;
+}
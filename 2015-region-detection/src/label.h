@@ -0,0 +1,52 @@
+#ifndef _LABEL_H_
+#define _LABEL_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "image.h"
+#include "typedefs.h"
+
+// Connected-component labelling, for images whose regions are not
+// rectangles.
+//
+// A component is a maximal set of pixels of one shade joined through their
+// left, right, top and bottom neighbours. Rows are run-length encoded and
+// each run is joined, with a union-find forest, to the runs of its shade that
+// it overlaps on the row above; the forest is resolved once at the end, so
+// the image is read once and never modified.
+//
+// A component's depth is the number of other components that must be crossed
+// to get from it to the edge of the image: those touching the edge have depth
+// 0, those enclosed only by them depth 1, and so on. For an image of nested
+// rectangles that each lie strictly inside their parent, the components are
+// the regions that find_regions() reports.
+
+typedef struct component {
+  region_t region;  // bounding box and nesting depth
+  long area;        // number of pixels
+  uint8_t shade;
+} component_t;
+
+// Components in the order of their first pixel, in [y, x] order.
+typedef struct component_set {
+  component_t *components;
+  int count;
+} component_set_t;
+
+// Finds the connected components of "image".
+void label_components(component_set_t *set, const image_t *image);
+
+// As label_components(), but labels bands of rows on "threads" threads (one
+// per online processor if "threads" is 0) and joins the bands at their
+// borders. The components found are the same.
+void label_components_parallel(component_set_t *set, const image_t *image,
+                               int threads);
+
+// Prints each component as print_region() prints a region, followed by its
+// area if "with_area" is set.
+void print_components(FILE *out, const component_set_t *set, int with_area);
+
+// Frees the components.
+void component_set_destroy(component_set_t *set);
+
+#endif
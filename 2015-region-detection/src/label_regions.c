@@ -0,0 +1,68 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "image.h"
+#include "image_map.h"
+#include "label.h"
+#include "region.h"
+#include "scan.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static void usage(const char *program)
+{
+  fprintf(stderr, "Usage: %s [-j threads] [-a] input_image\n", program);
+  fprintf(stderr, "Connected components of one shade, of any shape, are "
+          "written to standard\noutput as regions with their bounding "
+          "boxes; -a adds each one's area.\n");
+}
+
+// Labels the connected components of an image, for inputs whose regions are
+// not rectangles. Large images are labelled on every processor unless -j
+// says otherwise.
+int main(int argc, char **argv)
+{
+  int threads = 0, with_area = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:a")) != -1)
+  {
+    switch (opt)
+    {
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      case 'a':
+        with_area = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (optind != argc - 1 || threads < 0)
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  image_t *img_in = NULL;
+  image_error_t img_err = image_map_read(argv[optind], &img_in);
+  if (img_err)
+  {
+    image_print_error(img_err);
+    return EXIT_FAILURE;
+  }
+
+  component_set_t components;
+  if (threads == 0 &&
+      (long) img_in->width * img_in->height < SCAN_PARALLEL_MIN_PIXELS)
+  {
+    threads = 1;
+  }
+  label_components_parallel(&components, img_in, threads);
+  print_components(stdout, &components, with_area);
+
+  component_set_destroy(&components);
+  image_unmap(img_in);
+  return EXIT_SUCCESS;
+}
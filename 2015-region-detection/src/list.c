@@ -32,6 +32,8 @@ void list_init(list_t *list)
   list->footer->prev = list->header;
   list->header->prev = NULL;
   list->footer->next = NULL;
+  list->header->region = NULL;
+  list->footer->region = NULL;
 }
 
 // Return an iterator to the start of the list.
@@ -115,6 +117,55 @@ void list_insert_ascending(list_t *list, region_t *region)
   list_insert(e, region);
 }
 
+// Inserts "region" at the end of "list" in constant time. The list is left in
+// discovery order; list_sort() restores the region_compare() ordering.
+void list_append(list_t *list, region_t *region)
+{
+  list_insert(list_end(list), region);
+}
+
+// Sorts "list" into the ordering defined by region_compare() with
+// region_sort(), then puts the regions back into the list's elements in
+// their new order. A list that is already in order is left alone, so
+// sorting costs O(n) time and extra space.
+void list_sort(list_t *list)
+{
+  size_t n = 0;
+  int sorted = 1;
+  for (list_iter e = list_begin(list); e != list_end(list); e = e->next)
+  {
+    if (n++ > 0 && region_compare(e->region, e->prev->region))
+    {
+      sorted = 0;
+    }
+  }
+  if (sorted)
+  {
+    return;
+  }
+
+  region_t **regions = malloc(n * sizeof(region_t *));
+  if (regions == NULL)
+  {
+    perror("list_sort");
+    exit(EXIT_FAILURE);
+  }
+  size_t i = 0;
+  for (list_iter e = list_begin(list); e != list_end(list); e = e->next)
+  {
+    regions[i++] = e->region;
+  }
+
+  region_sort(regions, n);
+
+  i = 0;
+  for (list_iter e = list_begin(list); e != list_end(list); e = e->next)
+  {
+    e->region = regions[i++];
+  }
+  free(regions);
+}
+
 // Reclaims all memory used by the list_t data structure including any
 // contained region_t elements.
 void list_destroy(list_t *list)
@@ -52,6 +52,13 @@ void list_insert(list_iter iter, region_t *region);
 // region_compare().
 void list_insert_ascending(list_t *list, region_t  *region);
 
+// Inserts "region" at the end of "list" in constant time.
+void list_append(list_t *list, region_t *region);
+
+// Sorts "list" into the ordering defined by region_compare() in linear time.
+// Use with list_append() to build a large list, sorting once at the end.
+void list_sort(list_t *list);
+
 // Reclaims all memory used by the list_t data structure. region_t*
 // elements stored in the list are *not* reclaimed by this function.
 void list_destroy(list_t *list);
@@ -0,0 +1,115 @@
+#include "pgm_stream.h"
+#include "image.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Skips whitespace and comments, which run from '#' to the end of the line,
+ * up to the next header token.
+ */
+static void skip_separators(FILE *in)
+{
+  int c;
+  while ((c = fgetc(in)) != EOF)
+  {
+    if (c == '#')
+    {
+      while ((c = fgetc(in)) != EOF && c != '\n') { }
+    }
+    else if (!isspace(c))
+    {
+      ungetc(c, in);
+      return;
+    }
+  }
+}
+
+/*
+ * Reads a non-negative decimal header field. Returns 1 on success, otherwise
+ * 0.
+ */
+static int read_field(FILE *in, int *value)
+{
+  skip_separators(in);
+  return fscanf(in, "%d", value) == 1 && *value >= 0;
+}
+
+/*
+ * Opens a P5 PGM image and reads its header, leaving the stream at the first
+ * row of the raster. Returns IMG_OK on success or an appropriate error code on
+ * failure; the stream is open if and only if the return value is IMG_OK.
+ */
+image_error_t pgm_stream_open(pgm_stream_t *stream, const char *filename)
+{
+  stream->in = fopen(filename, "rb");
+  if (!stream->in)
+  {
+    return IMG_OPEN_FAILURE;
+  }
+
+  image_error_t error = IMG_OK;
+  int c1 = fgetc(stream->in), c2 = fgetc(stream->in);
+  if (c1 == EOF || c2 == EOF)
+  {
+    error = IMG_MISSING_FORMAT;
+  }
+  else if (c1 != 'P' || c2 != '5')
+  {
+    error = IMG_INVALID_FORMAT;
+  }
+  else if (!read_field(stream->in, &stream->width) ||
+           !read_field(stream->in, &stream->height))
+  {
+    error = IMG_INVALID_SIZE;
+  }
+  else if (!read_field(stream->in, &stream->depth) ||
+           stream->depth == 0 || stream->depth > DEPTH)
+  {
+    error = IMG_INVALID_DEPTH;
+  }
+  // a single whitespace character separates the header from the raster
+  else if (!isspace(fgetc(stream->in)))
+  {
+    error = IMG_READ_FAILURE;
+  }
+
+  if (error != IMG_OK)
+  {
+    fclose(stream->in);
+    return error;
+  }
+  stream->y = 0;
+  return IMG_OK;
+}
+
+/*
+ * Reads up to "count" further rows of the raster into "rows", which must have
+ * room for count * width bytes. Returns the number of rows read, which is
+ * fewer than "count" only at the end of the image or on a read error.
+ */
+int pgm_stream_read_rows(pgm_stream_t *stream, uint8_t *rows, int count)
+{
+  if (count > stream->height - stream->y)
+  {
+    count = stream->height - stream->y;
+  }
+  if (count <= 0)
+  {
+    return 0;
+  }
+  if (stream->width == 0)
+  {
+    stream->y += count;
+    return count;
+  }
+
+  size_t read = fread(rows, stream->width, count, stream->in);
+  stream->y += read;
+  return read;
+}
+
+void pgm_stream_close(pgm_stream_t *stream)
+{
+  fclose(stream->in);
+}
@@ -0,0 +1,24 @@
+#ifndef PGM_STREAM_H_
+#define PGM_STREAM_H_
+
+#include "image.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Sequential reader for binary (P5) PGM images that hands out the raster a
+ * few rows at a time, so that an image of any height can be processed in
+ * memory proportional to its width. Only 8 bit images are supported.
+ */
+typedef struct {
+  FILE *in;
+  int width, height;
+  int depth;
+  int y;
+} pgm_stream_t;
+
+image_error_t pgm_stream_open(pgm_stream_t *stream, const char *filename);
+int pgm_stream_read_rows(pgm_stream_t *stream, uint8_t *rows, int count);
+void pgm_stream_close(pgm_stream_t *stream);
+
+#endif
@@ -0,0 +1,90 @@
+#include "pool.h"
+#include "region.h"
+#include "list.h"
+#include "typedefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// The capacity of a pool's first block of regions.
+enum {POOL_INITIAL_CAPACITY = 64};
+
+void region_pool_init(region_pool_t *pool) {
+  pool->regions = NULL;
+  pool->count = pool->capacity = 0;
+}
+
+int region_pool_add(region_pool_t *pool, int x, int y, int width, int height,
+                    int depth) {
+  if (pool->count == pool->capacity) {
+    int capacity = pool->capacity ? 2 * pool->capacity : POOL_INITIAL_CAPACITY;
+    region_t *regions = realloc(pool->regions, capacity * sizeof(region_t));
+    if (regions == NULL) {
+      perror("region_pool_add");
+      exit(EXIT_FAILURE);
+    }
+    pool->regions = regions;
+    pool->capacity = capacity;
+  }
+
+  region_t *region = &pool->regions[pool->count];
+  region->depth = depth;
+  init_point(&region->position, x, y);
+  init_extent(&region->extent, width, height);
+  return pool->count++;
+}
+
+// Sorts pointers to the regions with region_sort(), as list_sort() does for
+// a list, then gathers the regions into a new array in one pass.
+void region_pool_sort(region_pool_t *pool) {
+  const size_t n = pool->count;
+  int sorted = 1;
+  for (size_t i = 1; i < n && sorted; i++) {
+    sorted = !region_compare(&pool->regions[i], &pool->regions[i - 1]);
+  }
+  if (sorted) {
+    return;
+  }
+
+  region_t **order = malloc(n * sizeof(region_t *));
+  region_t *regions = malloc(pool->capacity * sizeof(region_t));
+  if (order == NULL || regions == NULL) {
+    perror("region_pool_sort");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < n; i++) {
+    order[i] = &pool->regions[i];
+  }
+
+  region_sort(order, n);
+
+  for (size_t i = 0; i < n; i++) {
+    regions[i] = *order[i];
+  }
+  free(pool->regions);
+  pool->regions = regions;
+  free(order);
+}
+
+void region_pool_print(FILE *out, const region_pool_t *pool) {
+  for (int i = 0; i < pool->count; i++) {
+    print_region(out, &pool->regions[i]);
+  }
+}
+
+void region_pool_to_list(const region_pool_t *pool, list_t *list) {
+  for (int i = 0; i < pool->count; i++) {
+    region_t *region = region_allocate();
+    *region = pool->regions[i];
+    list_append(list, region);
+  }
+}
+
+void region_pool_clear(region_pool_t *pool) {
+  pool->count = 0;
+}
+
+void region_pool_destroy(region_pool_t *pool) {
+  free(pool->regions);
+  pool->regions = NULL;
+  pool->count = pool->capacity = 0;
+}
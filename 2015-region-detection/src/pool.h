@@ -0,0 +1,52 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "typedefs.h"
+
+// A growable, contiguous array of regions.
+//
+// The regions of an image live side by side in one block rather than in a
+// malloc() each, and are referred to by their index, which stays valid as
+// the pool grows. Sorting, printing and rendering walk the array in order,
+// and the whole pool is freed at once.
+
+typedef struct region_pool {
+  region_t *regions;
+  int count, capacity;
+} region_pool_t;
+
+// Initialises an empty pool.
+void region_pool_init(region_pool_t *pool);
+
+// Adds a region to the end of the pool and returns its index.
+int region_pool_add(region_pool_t *pool, int x, int y, int width, int height,
+                    int depth);
+
+// Returns the region at "index". The pointer is invalidated when a region
+// is added to the pool.
+static inline region_t *region_pool_get(const region_pool_t *pool, int index) {
+  return &pool->regions[index];
+}
+
+// Sorts the pool into the ordering defined by region_compare() in linear
+// time. A pool that is already in order is left alone. Indices taken before
+// the sort no longer refer to the same regions.
+void region_pool_sort(region_pool_t *pool);
+
+// Prints every region in the pool to "out", in pool order.
+void region_pool_print(FILE *out, const region_pool_t *pool);
+
+// Appends a copy of every region in the pool to "list", for code that works
+// on a list_t. list_destroy() frees the copies.
+void region_pool_to_list(const region_pool_t *pool, list_t *list);
+
+// Empties the pool but keeps its block, so a pool reused for image after
+// image only grows to the largest of them.
+void region_pool_clear(region_pool_t *pool);
+
+// Frees the pool's regions, all at once.
+void region_pool_destroy(region_pool_t *pool);
+
+#endif
@@ -0,0 +1,349 @@
+#include "quadtree.h"
+#include "pool.h"
+#include "typedefs.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// A leaf has no half-way lines; its "across" is LEAF.
+enum {LEAF = -1};
+
+// A region's index and its position along the line it crosses, for sorting.
+typedef struct keyed_item {
+  int key;
+  int index;
+} keyed_item_t;
+
+static void *grow(void *p, size_t size, const char *what) {
+  p = realloc(p, size);
+  if (p == NULL) {
+    perror(what);
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+static int compare_keys(const void *a, const void *b) {
+  const int ka = ((const keyed_item_t *) a)->key;
+  const int kb = ((const keyed_item_t *) b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+static int new_node(quadtree_t *tree, int x0, int y0, int x1, int y1) {
+  if (tree->node_count == tree->node_capacity) {
+    tree->node_capacity = 2 * tree->node_capacity + 16;
+    tree->nodes = grow(tree->nodes, tree->node_capacity * sizeof(quad_node_t),
+                       "region_index_build");
+  }
+  quad_node_t *node = &tree->nodes[tree->node_count];
+  node->x0 = x0;
+  node->y0 = y0;
+  node->x1 = x1;
+  node->y1 = y1;
+  node->first = node->count = 0;
+  node->across = LEAF;
+  for (int q = 0; q < 4; q++) {
+    node->children[q] = -1;
+  }
+  return tree->node_count++;
+}
+
+// Builds the node covering [x0, x1) x [y0, y1) over the "count" regions at
+// tree->items[first], which all lie within it and are in [y, x] order, and
+// returns its number. "scratch", "groups" and "keyed" have room for "count"
+// items; they are free again by the time the node's children are built.
+static int build_node(quadtree_t *tree, const region_pool_t *pool, int x0,
+                      int y0, int x1, int y1, int first, int count,
+                      int *scratch, uint8_t *groups, keyed_item_t *keyed) {
+  const int id = new_node(tree, x0, y0, x1, y1);
+  tree->nodes[id].first = first;
+  tree->nodes[id].count = count;
+  if (count <= QUADTREE_LEAF_SIZE || (x1 - x0 <= 1 && y1 - y0 <= 1)) {
+    return id;
+  }
+
+  // sort the regions into those crossing the vertical line, those crossing
+  // only the horizontal one and those in each quarter, keeping their order
+  const int mx = x0 + (x1 - x0) / 2, my = y0 + (y1 - y0) / 2;
+  int *items = tree->items + first;
+  int sizes[6] = {0};
+  for (int i = 0; i < count; i++) {
+    const region_t *r = &pool->regions[items[i]];
+    const int rx1 = r->position.x + r->extent.width;
+    const int ry1 = r->position.y + r->extent.height;
+    int g;
+    if (r->position.x < mx && rx1 > mx) {
+      g = 0;
+    } else if (r->position.y < my && ry1 > my) {
+      g = 1;
+    } else {
+      g = 2 + (r->position.x >= mx) + 2 * (r->position.y >= my);
+    }
+    groups[i] = g;
+    sizes[g]++;
+  }
+  int starts[6], at = 0;
+  for (int g = 0; g < 6; g++) {
+    starts[g] = at;
+    at += sizes[g];
+  }
+  for (int i = 0; i < count; i++) {
+    scratch[starts[groups[i]]++] = items[i];
+  }
+  memcpy(items, scratch, count * sizeof(int));
+
+  // the regions crossing the horizontal line go in x order
+  int *across = items + sizes[0];
+  for (int i = 0; i < sizes[1]; i++) {
+    keyed[i].key = pool->regions[across[i]].position.x;
+    keyed[i].index = across[i];
+  }
+  qsort(keyed, sizes[1], sizeof(keyed_item_t), compare_keys);
+  for (int i = 0; i < sizes[1]; i++) {
+    across[i] = keyed[i].index;
+  }
+
+  int children[4];
+  int start = first + sizes[0] + sizes[1];
+  for (int q = 0; q < 4; q++) {
+    const int n = sizes[2 + q];
+    children[q] = -1;
+    if (n > 0) {
+      children[q] = build_node(tree, pool, q & 1 ? mx : x0, q & 2 ? my : y0,
+                               q & 1 ? x1 : mx, q & 2 ? y1 : my, start, n,
+                               scratch, groups, keyed);
+    }
+    start += n;
+  }
+
+  // the node array may have moved
+  quad_node_t *node = &tree->nodes[id];
+  node->count = sizes[0];
+  node->across = sizes[1];
+  memcpy(node->children, children, sizeof(children));
+  return id;
+}
+
+void region_index_build(region_index_t *index, const region_pool_t *pool,
+                        int width, int height) {
+  index->pool = pool;
+  index->depths = 0;
+  for (int i = 0; i < pool->count; i++) {
+    if (pool->regions[i].depth >= index->depths) {
+      index->depths = pool->regions[i].depth + 1;
+    }
+  }
+  index->trees = calloc(index->depths > 0 ? index->depths : 1,
+                        sizeof(quadtree_t));
+  int *counts = calloc(index->depths + 1, sizeof(int));
+  int *scratch = malloc((pool->count + 1) * sizeof(int));
+  uint8_t *groups = malloc(pool->count + 1);
+  keyed_item_t *keyed = malloc((pool->count + 1) * sizeof(keyed_item_t));
+  if (!index->trees || !counts || !scratch || !groups || !keyed) {
+    perror("region_index_build");
+    exit(EXIT_FAILURE);
+  }
+
+  // deal the regions out by depth, keeping them in [y, x] order
+  for (int i = 0; i < pool->count; i++) {
+    const region_t *r = &pool->regions[i];
+    if (r->depth >= 0 && r->extent.width > 0 && r->extent.height > 0) {
+      counts[r->depth]++;
+    }
+  }
+  for (int d = 0; d < index->depths; d++) {
+    index->trees[d].items = malloc((counts[d] + 1) * sizeof(int));
+    if (index->trees[d].items == NULL) {
+      perror("region_index_build");
+      exit(EXIT_FAILURE);
+    }
+    counts[d] = 0;
+  }
+  for (int i = 0; i < pool->count; i++) {
+    const region_t *r = &pool->regions[i];
+    if (r->depth >= 0 && r->extent.width > 0 && r->extent.height > 0) {
+      index->trees[r->depth].items[counts[r->depth]++] = i;
+    }
+  }
+
+  for (int d = 0; d < index->depths; d++) {
+    if (counts[d] > 0) {
+      build_node(&index->trees[d], pool, 0, 0, width, height, 0, counts[d],
+                 scratch, groups, keyed);
+    }
+  }
+
+  free(counts);
+  free(scratch);
+  free(groups);
+  free(keyed);
+}
+
+static int contains(const region_t *r, int x, int y) {
+  return x >= r->position.x && x < r->position.x + r->extent.width &&
+         y >= r->position.y && y < r->position.y + r->extent.height;
+}
+
+// Returns the position in items[0..n) of the last region whose left edge
+// (if "by_x") or top edge is at or before "at", or -1 if there is none.
+static int last_starting(const region_pool_t *pool, const int *items, int n,
+                         int at, int by_x) {
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    const int mid = lo + (hi - lo) / 2;
+    const point_t *p = &pool->regions[items[mid]].position;
+    if ((by_x ? p->x : p->y) <= at) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo - 1;
+}
+
+// Returns the region of "tree" containing (x, y), or -1.
+static int tree_find(const quadtree_t *tree, const region_pool_t *pool, int x,
+                     int y) {
+  int id = tree->node_count > 0 ? 0 : -1;
+  while (id >= 0) {
+    const quad_node_t *node = &tree->nodes[id];
+    const int *items = tree->items + node->first;
+    if (node->across == LEAF) {
+      for (int i = 0; i < node->count; i++) {
+        if (contains(&pool->regions[items[i]], x, y)) {
+          return items[i];
+        }
+      }
+      return -1;
+    }
+
+    // at most one region on each line can hold the pixel: the last to
+    // start before it
+    int i = last_starting(pool, items, node->count, y, 0);
+    if (i >= 0 && contains(&pool->regions[items[i]], x, y)) {
+      return items[i];
+    }
+    items += node->count;
+    i = last_starting(pool, items, node->across, x, 1);
+    if (i >= 0 && contains(&pool->regions[items[i]], x, y)) {
+      return items[i];
+    }
+
+    const int mx = node->x0 + (node->x1 - node->x0) / 2;
+    const int my = node->y0 + (node->y1 - node->y0) / 2;
+    id = node->children[(x >= mx) + 2 * (y >= my)];
+  }
+  return -1;
+}
+
+int region_index_innermost(const region_index_t *index, int x, int y) {
+  // a pixel inside a region of some depth is inside one of every lesser
+  // depth, so the deepest with a region containing it is found by bisection
+  int found = -1, lo = 0, hi = index->depths - 1;
+  while (lo <= hi) {
+    const int mid = lo + (hi - lo) / 2;
+    const int r = tree_find(&index->trees[mid], index->pool, x, y);
+    if (r >= 0) {
+      found = r;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+// The rectangle of an intersection query and what to do with each region.
+typedef struct query {
+  int x0, y0, x1, y1;
+  region_visit_fn visit;
+  void *ctx;
+  int found;
+} query_t;
+
+static void visit_if_intersecting(const region_pool_t *pool, int index,
+                                  query_t *q) {
+  const region_t *r = &pool->regions[index];
+  if (r->position.x < q->x1 && r->position.x + r->extent.width > q->x0 &&
+      r->position.y < q->y1 && r->position.y + r->extent.height > q->y0) {
+    q->visit(q->ctx, index);
+    q->found++;
+  }
+}
+
+// Visits the regions on one line of a node, from the first that could reach
+// the query onwards, while they start before its far side. Being disjoint
+// along the line, their far edges are in the same order as their near ones.
+static void query_line(const region_pool_t *pool, const int *items, int n,
+                       int by_x, query_t *q) {
+  const int from = by_x ? q->x0 : q->y0, to = by_x ? q->x1 : q->y1;
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    const int mid = lo + (hi - lo) / 2;
+    const region_t *r = &pool->regions[items[mid]];
+    const int end = by_x ? r->position.x + r->extent.width
+                         : r->position.y + r->extent.height;
+    if (end <= from) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  for (int i = lo; i < n; i++) {
+    const point_t *p = &pool->regions[items[i]].position;
+    if ((by_x ? p->x : p->y) >= to) {
+      break;
+    }
+    visit_if_intersecting(pool, items[i], q);
+  }
+}
+
+static void query_node(const quadtree_t *tree, const region_pool_t *pool,
+                       int id, query_t *q) {
+  const quad_node_t *node = &tree->nodes[id];
+  if (node->x0 >= q->x1 || node->x1 <= q->x0 || node->y0 >= q->y1 ||
+      node->y1 <= q->y0) {
+    return;
+  }
+  const int *items = tree->items + node->first;
+  if (node->across == LEAF) {
+    for (int i = 0; i < node->count; i++) {
+      visit_if_intersecting(pool, items[i], q);
+    }
+    return;
+  }
+
+  query_line(pool, items, node->count, 0, q);
+  query_line(pool, items + node->count, node->across, 1, q);
+  for (int c = 0; c < 4; c++) {
+    if (node->children[c] >= 0) {
+      query_node(tree, pool, node->children[c], q);
+    }
+  }
+}
+
+int region_index_intersecting(const region_index_t *index, int x, int y,
+                              int width, int height, region_visit_fn visit,
+                              void *ctx) {
+  query_t q = {x, y, x + width, y + height, visit, ctx, 0};
+  if (width <= 0 || height <= 0) {
+    return 0;
+  }
+  for (int d = 0; d < index->depths; d++) {
+    if (index->trees[d].node_count > 0) {
+      query_node(&index->trees[d], index->pool, 0, &q);
+    }
+  }
+  return q.found;
+}
+
+void region_index_destroy(region_index_t *index) {
+  for (int d = 0; d < index->depths; d++) {
+    free(index->trees[d].nodes);
+    free(index->trees[d].items);
+  }
+  free(index->trees);
+  index->trees = NULL;
+  index->depths = 0;
+}
@@ -0,0 +1,67 @@
+#ifndef _QUADTREE_H_
+#define _QUADTREE_H_
+
+#include <stdint.h>
+#include "pool.h"
+#include "typedefs.h"
+
+// A spatial index over the regions of a pool, for finding the innermost
+// region containing a pixel, or the regions intersecting a rectangle, without
+// a pass over every region.
+//
+// Regions of one depth never overlap, so each depth gets a quadtree of its
+// own. A node halves the rectangle it covers across and down; a region that
+// crosses either half-way line stays in the node and the rest go down to the
+// quarter that holds them. The regions crossing one line are disjoint and all
+// meet it, so they are kept in order along it and binary searched. A pixel is
+// in a region of each depth down to that of the innermost region containing
+// it, so that depth is found by bisection over the depths as well.
+
+// Called with the index in the pool of each region a query finds.
+typedef void (*region_visit_fn)(void *ctx, int index);
+
+typedef struct quad_node {
+  int x0, y0, x1, y1;
+  // a leaf's regions are items[first] up to items[first + count]; an inner
+  // node's are the "count" that cross x = (x0 + x1) / 2, in y order, then
+  // the "across" that cross y = (y0 + y1) / 2 alone, in x order
+  int first, count, across;
+  int children[4];
+} quad_node_t;
+
+typedef struct quadtree {
+  quad_node_t *nodes;
+  int node_count, node_capacity;
+  int *items;
+} quadtree_t;
+
+typedef struct region_index {
+  const region_pool_t *pool;
+  quadtree_t *trees;
+  int depths;
+} region_index_t;
+
+// A node holding no more than QUADTREE_LEAF_SIZE regions is not split.
+enum {QUADTREE_LEAF_SIZE = 8};
+
+// Builds an index over the regions of "pool", which lie within a width x
+// height image and must be nested as find_pooled_regions() leaves them. The
+// pool must outlive the index and not change while it is in use.
+void region_index_build(region_index_t *index, const region_pool_t *pool,
+                        int width, int height);
+
+// Returns the index in the pool of the innermost region containing the pixel
+// (x, y), or -1 if there is none.
+int region_index_innermost(const region_index_t *index, int x, int y);
+
+// Calls "visit" with "ctx" for every region that shares at least one pixel
+// with the width x height rectangle at (x, y), and returns how many there
+// were.
+int region_index_intersecting(const region_index_t *index, int x, int y,
+                              int width, int height, region_visit_fn visit,
+                              void *ctx);
+
+// Frees the index; the pool is untouched.
+void region_index_destroy(region_index_t *index);
+
+#endif
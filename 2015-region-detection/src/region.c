@@ -1,10 +1,16 @@
 #include "region.h"
 #include "image.h"
+#include "image_fast.h"
 #include "typedefs.h"
 #include "list.h"
+#include "integral.h"
+#include "pool.h"
+#include "scan.h"
+#include "span.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 /////ALL THESE FUNCTIONS ARE PROVIDED FOR YOU/////////////////////
@@ -54,15 +60,25 @@ void print_region(FILE *out, const region_t *region) {
 // Finds all regions located in "image" and adds them to "regions".
 // Regions are added so that ordering according to the
 // comparison function region_compare() is preserved.
+// The regions are found into a pool (see find_pooled_regions()) and copied
+// to the list.
 void find_regions(list_t *regions, image_t *image) {
-  region_t *image_region = region_allocate();
-
-  image_region->depth = 0;
-  init_point(&image_region->position, 0, 0);
-  init_extent(&image_region->extent, image->width, image->height);
+  region_pool_t pool;
+  region_pool_init(&pool);
+  find_pooled_regions(&pool, image);
+  region_pool_to_list(&pool, regions);
+  region_pool_destroy(&pool);
+}
 
-  list_insert_ascending(regions, image_region);
-  find_sub_regions(regions, image, image_region);
+// Finds all regions located in "image" and adds them to "pool".
+// The image is scanned row by row and is not modified (see scan.h).
+// Large images are scanned in bands, one per processor, that are then merged.
+void find_pooled_regions(region_pool_t *pool, image_t *image) {
+  if ((long) image->width * image->height < SCAN_PARALLEL_MIN_PIXELS) {
+    scan_regions(pool, image);
+  } else {
+    scan_regions_parallel(pool, image, 0);
+  }
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -102,6 +118,73 @@ int region_compare(const region_t *r1, const region_t *r2) {
   return point_compare_less(&r1->position, &r2->position);
 }
 
+// The sort key of a region: its position packed so that comparing keys
+// compares positions in [y, x] order.
+static uint64_t region_key(const region_t *region) {
+  assert(region->position.x >= 0 && region->position.y >= 0);
+  return ((uint64_t) region->position.y << 32) | (uint32_t) region->position.x;
+}
+
+// Sorts the "n" region pointers in "regions" into the ordering defined by
+// region_compare(), using a least significant digit radix sort on the packed
+// position of each region. The sort is stable, and digits that are the same
+// in every key are skipped, so it costs O(n) time and extra space.
+void region_sort(region_t **regions, size_t n) {
+  if (n < 2) {
+    return;
+  }
+  uint64_t *keys = malloc(2 * n * sizeof(uint64_t));
+  region_t **scratch = malloc(n * sizeof(region_t *));
+  if (keys == NULL || scratch == NULL) {
+    perror("region_sort");
+    exit(EXIT_FAILURE);
+  }
+
+  // count every byte of every key in one pass
+  size_t counts[8][256];
+  memset(counts, 0, sizeof(counts));
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = region_key(regions[i]);
+    for (int d = 0; d < 8; d++) {
+      counts[d][(keys[i] >> (8 * d)) & 0xff]++;
+    }
+  }
+
+  region_t **from = regions, **to = scratch;
+  uint64_t *from_keys = keys, *to_keys = keys + n;
+  for (int d = 0; d < 8; d++) {
+    const int shift = 8 * d;
+    if (counts[d][(from_keys[0] >> shift) & 0xff] == n) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t count = counts[d][b];
+      counts[d][b] = offset;
+      offset += count;
+    }
+    for (size_t i = 0; i < n; i++) {
+      size_t j = counts[d][(from_keys[i] >> shift) & 0xff]++;
+      to[j] = from[i];
+      to_keys[j] = from_keys[i];
+    }
+
+    region_t **tmp = from;
+    from = to;
+    to = tmp;
+    uint64_t *tmp_keys = from_keys;
+    from_keys = to_keys;
+    to_keys = tmp_keys;
+  }
+
+  if (from != regions) {
+    memcpy(regions, from, n * sizeof(region_t *));
+  }
+  free(keys);
+  free(scratch);
+}
+
 // Prints all regions in "regions" to "out".
 // print_region (above) prints a textual description of a region
 // to the supplied FILE*
@@ -117,11 +200,12 @@ void print_regions(FILE *out, list_t *regions) {
 //
 void image_fill_region(image_t *image, const region_t *region, uint8_t value) {
   point_t pos = region->position;
-  // traverse region left-to-right and top-to-bottom
+  assert(pos.x >= 0 && pos.x + region->extent.width <= image->width);
+  assert(pos.y >= 0 && pos.y + region->extent.height <= image->height);
+
+  // fill region a row-span at a time, top-to-bottom
   for (int y = pos.y; y < pos.y + region->extent.height; y++) {
-    for (int x = pos.x; x < pos.x + region->extent.width; x++) {
-      set_pixel(image, x, y, value);
-    }
+    image_set_span(image, y, pos.x, pos.x + region->extent.width, value);
   }
 }
 
@@ -130,52 +214,451 @@ void image_fill_region(image_t *image, const region_t *region, uint8_t value) {
 // image: the image to be searched.
 // extent: this will be populated with the width and height of a region.
 void find_extent(extent_t *extent, image_t *image, const point_t *pos) {
-  uint8_t shade = get_pixel(image, pos->x, pos->y);
-  int x = pos->x, y = pos->y;
-
-  for (; get_pixel(image, x, pos->y) == shade; x++);
-  int width = x - pos->x;
+  assert(pos->x >= 0 && pos->x < image->width);
+  assert(pos->y >= 0 && pos->y < image->height);
+  const int step = image->nChannels;
+  const uint8_t *corner = image_row(image, pos->y) + pos->x * step;
+  uint8_t shade = *corner;
 
-  for (; get_pixel(image, pos->x, y) == shade; y++);
-  int height = y - pos->y;
+  // the runs stop at the edges of the image
+  int width = strided_mismatch(corner, step, image->width - pos->x, shade);
+  int height = column_mismatch(corner, image->widthStep,
+                               image->height - pos->y, shade);
 
   init_extent(extent, width, height);
 }
 
+// A region being searched for sub-regions, and how far the search has got.
+typedef struct search_frame {
+  const region_t *region;
+  uint8_t shade;
+  int x, y;
+} search_frame_t;
+
+// Appends all regions located in the region "current" of "image" to
+// "regions" in the order they are found.
+//
+// Each region is searched left-to-right and top-to-bottom; a sub-region is
+// searched as soon as it is found and then erased, so the search of its
+// parent carries on past it. Rather than recursing, the regions being
+// searched are kept on a heap-allocated stack, one frame per level of
+// nesting, so any depth of nesting is handled in memory proportional to it.
+static void
+collect_sub_regions(list_t *regions, image_t *image, const region_t *current) {
+  const int step = image->nChannels;
+  int capacity = 16, top = 0;
+  search_frame_t *stack = malloc(capacity * sizeof(search_frame_t));
+  if (stack == NULL) {
+    perror("collect_sub_regions");
+    exit(EXIT_FAILURE);
+  }
+  stack[0].region = current;
+  stack[0].shade = get_pixel(image, current->position.x, current->position.y);
+  stack[0].x = current->position.x;
+  stack[0].y = current->position.y;
+
+  while (top >= 0) {
+    search_frame_t *frame = &stack[top];
+    const region_t *region = frame->region;
+    const int min_x = region->position.x;
+    const int max_x = min_x + region->extent.width;
+    const int max_y = region->position.y + region->extent.height;
+
+    // carry on from where the search of this region left off
+    region_t *sub_region = NULL;
+    for (; frame->y < max_y; frame->y++, frame->x = min_x) {
+      const uint8_t *row = image_row(image, frame->y);
+      frame->x += strided_mismatch(row + frame->x * step, step,
+                                   max_x - frame->x, frame->shade);
+      if (frame->x < max_x) {
+        // new region detected; add it to regions and search it next
+        sub_region = region_allocate();
+        sub_region->depth = region->depth + 1;
+        init_point(&sub_region->position, frame->x, frame->y);
+        find_extent(&sub_region->extent, image, &sub_region->position);
+        list_append(regions, sub_region);
+        break;
+      }
+    }
+
+    if (sub_region != NULL) {
+      if (++top == capacity) {
+        capacity *= 2;
+        stack = realloc(stack, capacity * sizeof(search_frame_t));
+        if (stack == NULL) {
+          perror("collect_sub_regions");
+          exit(EXIT_FAILURE);
+        }
+      }
+      stack[top].region = sub_region;
+      stack[top].shade = get_pixel(image, sub_region->position.x,
+                                   sub_region->position.y);
+      stack[top].x = sub_region->position.x;
+      stack[top].y = sub_region->position.y;
+    } else if (top-- > 0) {
+      // erase the finished region and let its parent's search continue
+      image_fill_region(image, region, stack[top].shade);
+    }
+  }
+
+  free(stack);
+}
+
 // Finds all regions located in the region "current" of "image" and adds them
 // to "regions".  Regions are added so that ordering according to the
 // comparison function region_compare() is preserved.
 void
 find_sub_regions(list_t *regions, image_t *image, const region_t *current) {
+  collect_sub_regions(regions, image, current);
+  list_sort(regions);
+}
 
-  point_t pos = current->position;
-  uint8_t region_shade = get_pixel(image, pos.x, pos.y);
-  int max_y = pos.y + current->extent.height;
-  int max_x = pos.x + current->extent.width;
-
-  // traverse current region left-to-right and top-to-bottom
-  for (int y = pos.y; y < max_y; y++) {
-    for (int x = pos.x; x < max_x; x++) {
-      if (get_pixel(image, x, y) != region_shade) {
-        // new region detected
-        region_t *sub_region = region_allocate();
-        sub_region->depth = current->depth + 1;
-        init_point(&sub_region->position, x, y);
-        find_extent(&sub_region->extent, image, &sub_region->position);
-        // add to regions and recursively find_sub_regions
-        list_insert_ascending(regions, sub_region);
-        find_sub_regions(regions, image, sub_region);
-        // erase detected region and continue search
-        image_fill_region(image, sub_region, region_shade);
+// A region that covers the row being rendered.
+typedef struct render_entry {
+  int x0, x1, y1;
+  uint8_t colour;
+} render_entry_t;
+
+// Paints row y of image from the regions covering it, which are ordered by
+// x and, within one x, outermost first. Each pixel takes the colour of the
+// innermost region containing it and is written once. Returns -1, having
+// painted part of the row, if a region is not inside the one enclosing it
+// on this row, or 0.
+static int render_row(image_t *image, int y, const render_entry_t *active,
+                      int count, const render_entry_t **stack) {
+  int sp = 0, x = 0;
+  for (int i = 0; i <= count; i++) {
+    // close the regions that end before the next one starts
+    int next_x = i < count ? active[i].x0 : image->width;
+    while (sp > 0 && stack[sp - 1]->x1 <= next_x) {
+      image_set_span(image, y, x, stack[sp - 1]->x1, stack[sp - 1]->colour);
+      x = stack[--sp]->x1;
+    }
+    if (sp > 0) {
+      image_set_span(image, y, x, next_x, stack[sp - 1]->colour);
+    }
+    x = next_x;
+    if (i < count) {
+      if (sp > 0 && (stack[sp - 1]->x1 < active[i].x1 ||
+                     stack[sp - 1]->y1 < active[i].y1)) {
+        return -1;
+      }
+      stack[sp++] = &active[i];
+    }
+  }
+  return 0;
+}
+
+// Renders the regions in "pool" by sweeping the image a row at a time with
+// the set of regions covering that row, so every pixel is written exactly
+// once and the cost is O(image area + regions * height). Returns -1, having
+// painted part of the image, as soon as it finds that the regions are not
+// nested or not in region_compare() order, or 0.
+static int sweep_regions(image_t *image, const region_pool_t *pool,
+                         colour_function_t get_colour) {
+  int capacity = 0, fresh_capacity = 0, count = 0, status = 0;
+  render_entry_t *active = NULL, *fresh = NULL;
+  const render_entry_t **stack = NULL;
+
+  int e = 0;
+  for (int y = 0; y < image->height && status == 0; y++) {
+    // drop the regions that ended on the previous row
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+      if (active[i].y1 > y) {
+        active[kept++] = active[i];
+      }
+    }
+    count = kept;
+
+    // gather the regions that start on this row, which come in x order
+    int added = 0;
+    for (; e < pool->count && pool->regions[e].position.y <= y; e++) {
+      const region_t *region = &pool->regions[e];
+      if (region->position.y < y ||
+          (added > 0 && region->position.x < fresh[added - 1].x0)) {
+        status = -1;
+        break;
+      }
+      if (region->extent.width <= 0 || region->extent.height <= 0) {
+        continue;
+      }
+      if (added == fresh_capacity) {
+        fresh_capacity = 2 * fresh_capacity + 16;
+        fresh = realloc(fresh, fresh_capacity * sizeof(render_entry_t));
+        if (fresh == NULL) {
+          perror("render_regions");
+          exit(EXIT_FAILURE);
+        }
+      }
+      fresh[added].x0 = region->position.x;
+      fresh[added].x1 = region->position.x + region->extent.width;
+      fresh[added].y1 = region->position.y + region->extent.height;
+      fresh[added].colour = get_colour(region);
+      added++;
+    }
+
+    if (count + added > capacity) {
+      capacity = 2 * (count + added);
+      active = realloc(active, capacity * sizeof(render_entry_t));
+      stack = realloc(stack, capacity * sizeof(render_entry_t *));
+      if (active == NULL || stack == NULL) {
+        perror("render_regions");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    // merge from the back, keeping an older region ahead of a new one that
+    // starts at the same x, as the older one encloses it
+    int i = count - 1, j = added - 1;
+    for (int k = count + added - 1; j >= 0; k--) {
+      if (i >= 0 && active[i].x0 > fresh[j].x0) {
+        active[k] = active[i--];
+      } else {
+        active[k] = fresh[j--];
       }
     }
+    count += added;
+
+    if (status == 0) {
+      status = render_row(image, y, active, count, stack);
+    }
+  }
+
+  // regions starting below the image were never reached
+  if (status == 0 && e < pool->count) {
+    status = -1;
+  }
+
+  free(active);
+  free(fresh);
+  free(stack);
+  return status;
+}
+
+// Renders the regions in "pool" to an image using the supplied
+// colour_function_t (declared in typedefs.h) to select pixel intensity.
+//
+// Nested regions in region_compare() order, as find_pooled_regions() leaves
+// them, are swept a row at a time (see sweep_regions()). Any other regions
+// are painted one over another in pool order instead, which repaints every
+// pixel the sweep may have reached.
+void render_pooled_regions(image_t *image, const region_pool_t *pool,
+                           colour_function_t get_colour) {
+  if (sweep_regions(image, pool, get_colour) == 0) {
+    return;
+  }
+  for (int i = 0; i < pool->count; i++) {
+    const region_t *region = &pool->regions[i];
+    image_fill_region(image, region, get_colour(region));
+  }
+}
+
+// Reports a region that failed validation.
+static void report_invalid(FILE *out, const region_t *region,
+                           const char *reason) {
+  if (out != NULL) {
+    fprintf(out, "%s: ", reason);
+    print_region(out, region);
+  }
+}
+
+// Reports region "i" of "pool" as not a single shade, with the first pixel
+// outside its sub-regions that is not of its "shade". Only failures are
+// reported, so the sub-regions are found by a walk over "parents".
+static void report_stray_pixel(FILE *out, const integral_t *table,
+                               const region_pool_t *pool, const int *parents,
+                               int i, uint8_t shade) {
+  if (out == NULL) {
+    return;
+  }
+  const region_t **children = malloc(pool->count * sizeof(region_t *));
+  if (children == NULL) {
+    perror("validate_pooled_regions");
+    exit(EXIT_FAILURE);
+  }
+  int count = 0;
+  for (int j = i + 1; j < pool->count; j++) {
+    if (parents[j] == i) {
+      children[count++] = &pool->regions[j];
+    }
+  }
+
+  point_t at;
+  const region_t *region = &pool->regions[i];
+  if (integral_find_mismatch(table, region, children, count, shade, &at)) {
+    fprintf(out, "not a single shade, pixel (%d, %d) differs: ", at.x, at.y);
+    print_region(out, region);
+  } else {
+    report_invalid(out, region, "not a single shade");
+  }
+  free(children);
+}
+
+// Returns the position in "active", which holds the indices of regions
+// ordered as render_pooled_regions() orders them, of the first region whose
+// left edge is after x.
+static int active_after(const region_pool_t *pool, const int *active,
+                        int count, int x) {
+  int lo = 0, hi = count;
+  while (lo < hi) {
+    const int mid = (lo + hi) / 2;
+    if (pool->regions[active[mid]].position.x <= x) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
   }
+  return lo;
+}
+
+// The regions' parents are found by sweeping down the image with the regions
+// covering each row, as render_pooled_regions() does; each region's own
+// totals are then its rectangle's less its children's, so every region is
+// checked with O(1) table queries.
+int validate_pooled_regions(const integral_t *table,
+                            const region_pool_t *pool, FILE *out) {
+  const int n = pool->count;
+  int *parents = malloc(n * sizeof(int));
+  int *active = malloc(n * sizeof(int));
+  integral_cell_t *totals = malloc(n * sizeof(integral_cell_t));
+  uint64_t *areas = malloc(n * sizeof(uint64_t));
+  if (n > 0 && (!parents || !active || !totals || !areas)) {
+    perror("validate_pooled_regions");
+    exit(EXIT_FAILURE);
+  }
+
+  int invalid = 0, count = 0, y = -1;
+  for (int i = 0; i < n; i++) {
+    const region_t *region = &pool->regions[i];
+    const int x0 = region->position.x, y0 = region->position.y;
+    const int x1 = x0 + region->extent.width;
+    const int y1 = y0 + region->extent.height;
+    parents[i] = -1;
+    totals[i].sum = totals[i].sum_sq = 0;
+    areas[i] = 0;
+
+    if (x0 < 0 || y0 < 0 || x1 > table->width || y1 > table->height ||
+        x1 <= x0 || y1 <= y0 || (i > 0 && y0 < y)) {
+      report_invalid(out, region, "out of bounds or order");
+      invalid++;
+      continue;
+    }
+
+    // drop the regions that ended above this row
+    if (y0 > y) {
+      int kept = 0;
+      for (int j = 0; j < count; j++) {
+        const region_t *r = &pool->regions[active[j]];
+        if (r->position.y + r->extent.height > y0) {
+          active[kept++] = active[j];
+        }
+      }
+      count = kept;
+      y = y0;
+    }
+
+    // the innermost region containing x0 encloses the last one to start at
+    // or before it, so it is found by walking up from there
+    const int at = active_after(pool, active, count, x0);
+    int p = at > 0 ? active[at - 1] : -1;
+    while (p >= 0 && pool->regions[p].position.x +
+                     pool->regions[p].extent.width <= x0) {
+      p = parents[p];
+    }
+    if (p >= 0) {
+      const region_t *parent = &pool->regions[p];
+      if (x1 > parent->position.x + parent->extent.width ||
+          y1 > parent->position.y + parent->extent.height ||
+          region->depth != parent->depth + 1) {
+        report_invalid(out, region, "not nested in its parent");
+        invalid++;
+        continue;
+      }
+      parents[i] = p;
+    } else if (region->depth != 0) {
+      report_invalid(out, region, "no parent");
+      invalid++;
+      continue;
+    }
+
+    memmove(active + at + 1, active + at, (count - at) * sizeof(int));
+    active[at] = i;
+    count++;
+  }
+
+  // take each region's rectangle out of its parent's totals
+  for (int i = 0; i < n; i++) {
+    const region_t *region = &pool->regions[i];
+    if (parents[i] < 0 && region->depth != 0) {
+      continue;
+    }
+    const integral_cell_t rect = integral_rect(table, region->position.x,
+                                               region->position.y,
+                                               region->extent.width,
+                                               region->extent.height);
+    totals[i].sum += rect.sum;
+    totals[i].sum_sq += rect.sum_sq;
+    areas[i] += (uint64_t) region->extent.width * region->extent.height;
+    if (parents[i] >= 0) {
+      totals[parents[i]].sum -= rect.sum;
+      totals[parents[i]].sum_sq -= rect.sum_sq;
+      areas[parents[i]] -= (uint64_t) region->extent.width *
+                           region->extent.height;
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    const region_t *region = &pool->regions[i];
+    if (parents[i] < 0 && region->depth != 0) {
+      continue;
+    }
+    const uint8_t shade = integral_pixel(table, region->position.x,
+                                         region->position.y);
+    if (!integral_totals_uniform(totals[i], areas[i], shade)) {
+      report_stray_pixel(out, table, pool, parents, i, shade);
+      invalid++;
+    } else if (parents[i] >= 0) {
+      const region_t *parent = &pool->regions[parents[i]];
+      if (shade == integral_pixel(table, parent->position.x,
+                                  parent->position.y)) {
+        report_invalid(out, region, "same shade as its parent");
+        invalid++;
+      }
+    }
+  }
+
+  free(parents);
+  free(active);
+  free(totals);
+  free(areas);
+  return invalid;
 }
 
 // Renders all regions to an image using the supplied colour_function_t
-// (declared in typedefs.h) to select pixel intensity.
+// (declared in typedefs.h) to select pixel intensity. The regions are copied
+// into a pool and rendered by render_pooled_regions(): nested regions in
+// region_compare() order, as find_regions() leaves them, are swept, and any
+// other list is painted in list order as render_regions_overdraw() does.
 void render_regions(image_t *image, list_t *regions,
                     colour_function_t get_colour) {
+  region_pool_t pool;
+  region_pool_init(&pool);
+  for (list_iter e = list_begin(regions); e != list_end(regions);
+       e = e->next) {
+    const region_t *region = e->region;
+    region_pool_add(&pool, region->position.x, region->position.y,
+                    region->extent.width, region->extent.height,
+                    region->depth);
+  }
+  render_pooled_regions(image, &pool, get_colour);
+  region_pool_destroy(&pool);
+}
+
+// Renders all regions to an image by filling each in list order, so that a
+// region paints over those before it.
+void render_regions_overdraw(image_t *image, list_t *regions,
+                             colour_function_t get_colour) {
   for (list_elem_t *e = list_begin(regions); e != list_end(regions); e = e->next) {
     image_fill_region(image, e->region, get_colour(e->region));
   }
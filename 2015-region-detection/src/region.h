@@ -2,6 +2,8 @@
 #define _REGIONS_H_
 
 #include "image.h"
+#include "integral.h"
+#include "pool.h"
 #include "typedefs.h"
 #include <stdint.h>
 #include <stdio.h>
@@ -58,6 +60,11 @@ void region_destroy(region_t *region);
 // of the second, otherwise returns 0.
 int region_compare(const region_t *first, const region_t *second);
 
+// Sorts an array of "n" pointers to regions into the ordering defined by
+// region_compare() in linear time. Regions with equal positions keep their
+// order.
+void region_sort(region_t **regions, size_t n);
+
 // Prints all regions in "regions" to "out".
 // print_region (above) prints a textual description of a region to
 // the supplied FILE*
@@ -84,5 +91,29 @@ void find_sub_regions(list_t *regions, image_t *image,
 //(declared in region.h) to select pixel intensity.
 void render_regions(image_t *image, list_t *regions,
                     colour_function_t get_colour);
+
+// Renders regions by painting each region in list order over those before
+// it, at the cost of painting nested regions many times. render_regions()
+// gives the same image, writing each pixel once when the list is nested and
+// in region_compare() order.
+void render_regions_overdraw(image_t *image, list_t *regions,
+                             colour_function_t get_colour);
+
+// Finds all regions located in "image" and adds them to "pool", in the
+// ordering defined by region_compare(), as find_regions() does for a list.
+void find_pooled_regions(region_pool_t *pool, image_t *image);
+
+// Renders the regions in "pool" as render_regions() does for a list; it is
+// fastest for regions in the order find_pooled_regions() leaves them.
+void render_pooled_regions(image_t *image, const region_pool_t *pool,
+                           colour_function_t get_colour);
+
+// Checks the regions in "pool", in the order find_pooled_regions() leaves
+// them, against the summed-area tables of their image: the regions must nest,
+// the pixels of each region outside its sub-regions must all share a shade,
+// and that shade must differ from the parent region's. Each region that fails
+// is described on "out", if it is not NULL. Returns the number that fail.
+int validate_pooled_regions(const integral_t *table,
+                            const region_pool_t *pool, FILE *out);
 //////////////////////////////////////////////////////////////////////////////
 #endif
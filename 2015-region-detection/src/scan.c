@@ -0,0 +1,493 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "scan.h"
+#include "region.h"
+#include "image.h"
+#include "image_fast.h"
+#include "typedefs.h"
+#include "pool.h"
+#include "span.h"
+#include "pgm_stream.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+
+// Grows the scanner's arrays so that they can hold at least "count" open
+// regions.
+static void reserve(scanner_t *s, int count) {
+  if (count <= s->capacity) {
+    return;
+  }
+  int capacity = s->capacity * 2;
+  if (capacity < count) {
+    capacity = count;
+  }
+
+  s->open = realloc(s->open, capacity * sizeof(scan_entry_t));
+  s->next = realloc(s->next, capacity * sizeof(scan_entry_t));
+  s->stack = realloc(s->stack, capacity * sizeof(int));
+  s->alive = realloc(s->alive, capacity * sizeof(uint8_t));
+  if (!s->open || !s->next || !s->stack || !s->alive) {
+    perror("scanner");
+    exit(EXIT_FAILURE);
+  }
+  s->capacity = capacity;
+}
+
+// Fills in "entry" for a region that has just started on row y, adding the
+// region to the pool unless the scan is streaming.
+static void open_region(scanner_t *s, scan_entry_t *entry, int x, int y,
+                        int width, int height, int depth) {
+  entry->region.depth = depth;
+  init_point(&entry->region.position, x, y);
+  init_extent(&entry->region.extent, width, height);
+  entry->index = -1;
+  if (s->pool != NULL) {
+    entry->index = region_pool_add(s->pool, x, y, width, height, depth);
+  }
+}
+
+// Sets the height of a region that is no longer open on row y. A streaming
+// scanner hands the finished region on.
+static void close_region(scanner_t *s, scan_entry_t *entry, int y) {
+  entry->region.extent.height = y - entry->region.position.y;
+  if (s->emit != NULL) {
+    s->emit(s->ctx, &entry->region);
+  } else {
+    region_pool_get(s->pool, entry->index)->extent = entry->region.extent;
+  }
+}
+
+void scanner_init(scanner_t *s, region_pool_t *pool,
+                  int width, int height, int step) {
+  s->pool = pool;
+  s->emit = NULL;
+  s->ctx = NULL;
+  s->width = width;
+  s->height = height;
+  s->step = step;
+  s->y = 0;
+  s->open = s->next = NULL;
+  s->stack = NULL;
+  s->alive = NULL;
+  s->capacity = 0;
+  reserve(s, 16);
+
+  s->runs = malloc((width + 1) * sizeof(scan_run_t));
+  if (s->runs == NULL) {
+    perror("scanner");
+    exit(EXIT_FAILURE);
+  }
+
+  open_region(s, &s->open[0], 0, 0, width, height, 0);
+  s->open[0].x1 = width;
+  s->open[0].shade = 0;
+  s->count = 1;
+}
+
+int scan_encode_row(scan_run_t *runs, const uint8_t *row, int width,
+                    int step) {
+  int n = 0;
+  for (int x = 0; x < width;) {
+    const uint8_t shade = row[x * step];
+    runs[n].x = x;
+    runs[n].shade = shade;
+    n++;
+    x++;
+    x += strided_mismatch(row + x * step, step, width - x, shade);
+  }
+  return n;
+}
+
+void scanner_feed_runs(scanner_t *s, const scan_run_t *runs, int count) {
+  assert(s->y < s->height);
+  const int y = s->y++;
+  const int width = s->width;
+  int n = 0, r = 0;
+
+  // keep the regions whose left edge continues on this row; a region closes
+  // with its parent, which precedes it in preorder at one less depth. The
+  // left edges are in order, so one pass over the runs finds their pixels
+  for (int i = 0; i < s->count; i++) {
+    scan_entry_t *e = &s->open[i];
+    int depth = e->region.depth;
+    int alive = depth == 0;
+    if (!alive && s->alive[depth - 1]) {
+      const int x0 = e->region.position.x;
+      for (; r + 1 < count && runs[r + 1].x <= x0; r++);
+      alive = runs[r].shade == e->shade;
+    }
+    s->alive[depth] = alive;
+    if (alive) {
+      s->next[n++] = *e;
+    } else {
+      close_region(s, e, y);
+    }
+  }
+
+  // the image region's shade is that of its top-left pixel
+  if (y == 0 && count > 0) {
+    s->next[0].shade = runs[0].shade;
+  }
+
+  scan_entry_t *tmp = s->open;
+  s->open = s->next;
+  s->next = tmp;
+  s->count = n;
+
+  // walk the row, looking for runs that differ from the innermost open
+  // region containing them and rebuilding the open list in preorder
+  int k = 0, m = 0, sp = 0;
+  int x = 0;
+  r = 0;
+  while (x < width) {
+    while (sp > 0 && s->next[s->stack[sp - 1]].x1 <= x) {
+      sp--;
+    }
+    while (k < n && s->open[k].region.position.x <= x) {
+      reserve(s, m + 1);
+      s->next[m] = s->open[k++];
+      s->stack[sp++] = m++;
+    }
+
+    const scan_entry_t *top = &s->next[s->stack[sp - 1]];
+    const uint8_t shade = top->shade;
+    int limit = top->x1;
+    if (k < n && s->open[k].region.position.x < limit) {
+      limit = s->open[k].region.position.x;
+    }
+
+    // skip the runs of the enclosing region's shade
+    for (; r + 1 < count && runs[r + 1].x <= x; r++);
+    while (x < limit && runs[r].shade == shade) {
+      int end = r + 1 < count ? runs[r + 1].x : width;
+      if (end > limit) {
+        x = limit;
+      } else {
+        x = end;
+        r++;
+      }
+    }
+    if (x == limit) {
+      continue;
+    }
+
+    // new region detected; its top row is the rest of the run
+    int x1 = r + 1 < count ? runs[r + 1].x : width;
+    if (x1 > limit) {
+      x1 = limit;
+    }
+
+    reserve(s, m + 1);
+    top = &s->next[s->stack[sp - 1]];
+    open_region(s, &s->next[m], x, y, x1 - x, 0, top->region.depth + 1);
+    s->next[m].x1 = x1;
+    s->next[m].shade = runs[r].shade;
+    m++;
+    x = x1;
+  }
+
+  tmp = s->open;
+  s->open = s->next;
+  s->next = tmp;
+  s->count = m;
+}
+
+void scanner_feed_row(scanner_t *s, const uint8_t *row) {
+  int count = scan_encode_row(s->runs, row, s->width, s->step);
+  scanner_feed_runs(s, s->runs, count);
+}
+
+void scanner_init_streaming(scanner_t *s, scan_emit_fn emit, void *ctx,
+                            int width, int height, int step) {
+  assert(emit != NULL);
+  scanner_init(s, NULL, width, height, step);
+  s->emit = emit;
+  s->ctx = ctx;
+}
+
+// Frees the scanner's working memory.
+static void scanner_release(scanner_t *s) {
+  free(s->open);
+  free(s->next);
+  free(s->stack);
+  free(s->alive);
+  free(s->runs);
+}
+
+void scanner_finish(scanner_t *s) {
+  for (int i = 1; i < s->count; i++) {
+    close_region(s, &s->open[i], s->y);
+  }
+  if (s->emit != NULL) {
+    s->emit(s->ctx, &s->open[0].region);
+  } else {
+    region_pool_sort(s->pool);
+  }
+  scanner_release(s);
+}
+
+void scan_regions(region_pool_t *pool, image_t *image) {
+  scanner_t scanner;
+  scanner_init(&scanner, pool, image->width, image->height,
+               image->nChannels);
+  for (int y = 0; y < image->height; y++) {
+    scanner_feed_row(&scanner, image_row(image, y));
+  }
+  scanner_finish(&scanner);
+}
+
+// A band of rows scanned by a worker as though no region from above it were
+// open at its top: the fragment of the image's regions that the sweep
+// finds in it when started from the whole-image region alone. Regions still
+// open at the bottom of the band have a height of 0. hashes[i] is
+// open_hash() of the sweep at the start of row y0 + i, and "last" holds the
+// "last_count" regions open at the bottom of the band.
+typedef struct scan_band {
+  const image_t *image;
+  int y0, y1;
+  region_pool_t fragment;
+  uint64_t *hashes;
+  scan_entry_t *last;
+  int last_count;
+} scan_band_t;
+
+// Hashes everything about the regions open in the sweep that decides how it
+// goes on: their left and right edges, shades and depths, in order. Where
+// the tops of the regions are is left out.
+static uint64_t open_hash(const scanner_t *s) {
+  uint64_t h = 14695981039346656037ULL ^ s->count;
+  for (int i = 0; i < s->count; i++) {
+    const scan_entry_t *e = &s->open[i];
+    h = (h ^ (((uint64_t) e->region.position.x << 32) | (uint32_t) e->x1)) *
+        1099511628211ULL;
+    h = (h ^ ((uint64_t) e->region.depth << 8 | e->shade)) * 1099511628211ULL;
+  }
+  return h;
+}
+
+static void *scan_band(void *arg) {
+  scan_band_t *band = arg;
+  const image_t *image = band->image;
+
+  region_pool_init(&band->fragment);
+  band->hashes = malloc((band->y1 - band->y0 + 1) * sizeof(uint64_t));
+  if (band->hashes == NULL) {
+    perror("scan_band");
+    exit(EXIT_FAILURE);
+  }
+
+  scanner_t scanner;
+  scanner_init(&scanner, &band->fragment, image->width, image->height,
+               image->nChannels);
+  scanner.y = band->y0;
+  scanner.open[0].shade = image->pixelsData[0];
+  for (int y = band->y0; y < band->y1; y++) {
+    band->hashes[y - band->y0] = open_hash(&scanner);
+    scanner_feed_row(&scanner, image_row(image, y));
+  }
+  band->hashes[band->y1 - band->y0] = open_hash(&scanner);
+
+  // hand the open regions over as they are, rather than closing them
+  band->last = scanner.open;
+  band->last_count = scanner.count;
+  scanner.open = NULL;
+  scanner_release(&scanner);
+  return NULL;
+}
+
+// A region of a fragment open at some row, ordered for the preorder of the
+// sweep's open regions: by left edge, and parents before their children.
+typedef struct scan_open {
+  int x, depth, index;
+} scan_open_t;
+
+static int compare_open(const void *a, const void *b) {
+  const scan_open_t *o1 = a, *o2 = b;
+  if (o1->x != o2->x) {
+    return o1->x < o2->x ? -1 : 1;
+  }
+  return (o1->depth > o2->depth) - (o1->depth < o2->depth);
+}
+
+// Takes over the rest of "band" from row y, which the sweep has reached, if
+// the regions open in the sweep are the band's at that row. The sweeps then
+// go on identically, so the band's regions that start from row y on are
+// added to the pool, the heights of the open regions that close within the
+// band are set, and the sweep skips to the bottom of the band. Returns 1 if
+// the band was taken over, otherwise 0.
+static int splice_band(scanner_t *s, const scan_band_t *band, int y) {
+  const region_pool_t *fragment = &band->fragment;
+  const image_t *image = band->image;
+
+  // the band's regions open at the start of row y
+  scan_open_t *open = malloc(fragment->count * sizeof(scan_open_t));
+  int *map = malloc(fragment->count * sizeof(int));
+  if (open == NULL || map == NULL) {
+    perror("splice_band");
+    exit(EXIT_FAILURE);
+  }
+  int count = 0;
+  for (int i = 0; i < fragment->count; i++) {
+    const region_t *r = &fragment->regions[i];
+    const int height = i == 0 ? 0 : r->extent.height;
+    map[i] = -1;
+    if (r->position.y < y && (height == 0 || r->position.y + height >= y)) {
+      open[count].x = r->position.x;
+      open[count].depth = r->depth;
+      open[count].index = i;
+      count++;
+    }
+  }
+  qsort(open, count, sizeof(scan_open_t), compare_open);
+
+  int same = count == s->count;
+  for (int i = 0; i < count && same; i++) {
+    const region_t *r = &fragment->regions[open[i].index];
+    const scan_entry_t *e = &s->open[i];
+    const int x1 = i == 0 ? image->width : r->position.x + r->extent.width;
+    same = e->region.position.x == r->position.x && e->x1 == x1 &&
+           e->region.depth == r->depth &&
+           e->shade == get_pixel_fast(image, r->position.x, r->position.y);
+  }
+  if (!same) {
+    free(open);
+    free(map);
+    return 0;
+  }
+
+  // the open regions are the sweep's own, and close where the band's do
+  for (int i = 0; i < count; i++) {
+    const region_t *r = &fragment->regions[open[i].index];
+    map[open[i].index] = s->open[i].index;
+    if (i > 0 && r->extent.height > 0) {
+      region_t *region = region_pool_get(s->pool, s->open[i].index);
+      region->extent.height = r->position.y + r->extent.height -
+                              region->position.y;
+    }
+  }
+  for (int i = 1; i < fragment->count; i++) {
+    const region_t *r = &fragment->regions[i];
+    if (r->position.y >= y) {
+      map[i] = region_pool_add(s->pool, r->position.x, r->position.y,
+                               r->extent.width, r->extent.height, r->depth);
+    }
+  }
+
+  reserve(s, band->last_count);
+  for (int i = 0; i < band->last_count; i++) {
+    const int index = map[band->last[i].index];
+    s->open[i] = band->last[i];
+    s->open[i].region = *region_pool_get(s->pool, index);
+    s->open[i].index = index;
+  }
+  s->count = band->last_count;
+  s->y = band->y1;
+
+  free(open);
+  free(map);
+  return 1;
+}
+
+void scan_regions_parallel(region_pool_t *pool, image_t *image, int threads) {
+  if (threads <= 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? online : 1;
+  }
+  int bands = image->height / SCAN_BAND_ROWS;
+  if (bands > threads) {
+    bands = threads;
+  }
+  if (bands <= 1) {
+    scan_regions(pool, image);
+    return;
+  }
+
+  // the calling thread sweeps the first band itself while the others are
+  // scanned for their fragments
+  scan_band_t *band = calloc(bands, sizeof(scan_band_t));
+  pthread_t *ids = malloc(bands * sizeof(pthread_t));
+  if (band == NULL || ids == NULL) {
+    perror("scan_regions_parallel");
+    exit(EXIT_FAILURE);
+  }
+  for (int b = 0; b < bands; b++) {
+    band[b].image = image;
+    band[b].y0 = (long) image->height * b / bands;
+    band[b].y1 = (long) image->height * (b + 1) / bands;
+  }
+  for (int b = 1; b < bands; b++) {
+    if (pthread_create(&ids[b], NULL, scan_band, &band[b])) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  scanner_t scanner;
+  scanner_init(&scanner, pool, image->width, image->height,
+               image->nChannels);
+  for (int y = 0; y < band[0].y1; y++) {
+    scanner_feed_row(&scanner, image_row(image, y));
+  }
+
+  // merge along each seam: sweep on into the next band until the regions
+  // open match the band's at the same row, then take the rest of the band
+  // from its fragment. A band whose open regions never match is swept whole
+  for (int b = 1; b < bands; b++) {
+    pthread_join(ids[b], NULL);
+    for (int y = band[b].y0;; y++) {
+      if (open_hash(&scanner) == band[b].hashes[y - band[b].y0] &&
+          splice_band(&scanner, &band[b], y)) {
+        break;
+      }
+      if (y == band[b].y1) {
+        break;
+      }
+      scanner_feed_row(&scanner, image_row(image, y));
+    }
+    region_pool_destroy(&band[b].fragment);
+    free(band[b].hashes);
+    free(band[b].last);
+  }
+  scanner_finish(&scanner);
+
+  free(band);
+  free(ids);
+}
+
+image_error_t scan_pgm_stream(const char *filename, scan_emit_fn emit,
+                              void *ctx) {
+  pgm_stream_t stream;
+  image_error_t err = pgm_stream_open(&stream, filename);
+  if (err != IMG_OK) {
+    return err;
+  }
+
+  uint8_t *rows = malloc((size_t) SCAN_STREAM_ROWS * stream.width + 1);
+  if (rows == NULL) {
+    pgm_stream_close(&stream);
+    return IMG_INSUFFICIENT_MEMORY;
+  }
+
+  scanner_t scanner;
+  scanner_init_streaming(&scanner, emit, ctx, stream.width, stream.height, 1);
+  while (stream.y < stream.height) {
+    int count = pgm_stream_read_rows(&stream, rows, SCAN_STREAM_ROWS);
+    if (count == 0) {
+      err = IMG_READ_FAILURE;
+      break;
+    }
+    for (int i = 0; i < count; i++) {
+      scanner_feed_row(&scanner, rows + (size_t) i * stream.width);
+    }
+  }
+  // a short raster still closes, and emits, every open region
+  scanner_finish(&scanner);
+
+  free(rows);
+  pgm_stream_close(&stream);
+  return err;
+}
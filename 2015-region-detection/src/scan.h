@@ -0,0 +1,128 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include "image.h"
+#include "pool.h"
+#include "typedefs.h"
+#include <stdint.h>
+
+// Single-pass region detection over the rows of an image.
+//
+// The scanner is fed one row at a time, top to bottom, as runs of pixels of
+// one shade. It keeps the regions that are open on the current row in
+// preorder (by x, parents before their children). A region stays open while
+// the pixel at its left edge keeps its shade and its parent is open; any run
+// that differs from the shade of the innermost open region containing it
+// starts a new region as wide as the run. The image is never written, and
+// after run-length encoding each row is processed in time proportional to its
+// runs, so the cost is O(width * height + runs + regions).
+//
+// Regions are added to a region pool as soon as they start, and a region's
+// height is filled in, through its index, when it closes. They are discovered
+// in [y, x] order, so the final region_pool_sort() only has to confirm the
+// order of a fresh pool.
+//
+// A streaming scanner keeps no pool: each region is passed to a callback as
+// soon as its bottom edge is seen, so the scanner only holds the regions open
+// on the current row and its memory is proportional to the width of the
+// image.
+
+// The pixels of a row from x up to the start of the next run, or the end of
+// the row, all have the same shade.
+typedef struct scan_run {
+  int x;
+  uint8_t shade;
+} scan_run_t;
+
+// Receives a finished region from a streaming scanner. The region is only
+// valid until the callback returns.
+typedef void (*scan_emit_fn)(void *ctx, const region_t *region);
+
+// An open region, its index in the pool, and the information needed to scan
+// past it. The region's height is set when it closes.
+typedef struct scan_entry {
+  region_t region;
+  int index;
+  int x1;
+  uint8_t shade;
+} scan_entry_t;
+
+typedef struct scanner {
+  region_pool_t *pool;
+  scan_emit_fn emit;
+  void *ctx;
+  int width, height, step;
+  int y;
+
+  // open regions on the previous row and those being built for the current
+  // one; stack holds indices into next of the regions containing x
+  scan_entry_t *open, *next;
+  int count, capacity;
+  int *stack;
+  uint8_t *alive;
+
+  // the current row, run-length encoded
+  scan_run_t *runs;
+} scanner_t;
+
+// A parallel scan gives each thread a band of at least SCAN_BAND_ROWS rows,
+// and images smaller than SCAN_PARALLEL_MIN_PIXELS are not worth the
+// threads.
+enum {SCAN_BAND_ROWS = 256};
+enum {SCAN_PARALLEL_MIN_PIXELS = 1 << 22};
+
+// A streaming scan reads SCAN_STREAM_ROWS rows of the file at a time.
+enum {SCAN_STREAM_ROWS = 64};
+
+// Starts a scan of a width x height image whose pixels are step bytes apart,
+// adding the whole-image region of depth 0 to "pool".
+void scanner_init(scanner_t *scanner, region_pool_t *pool,
+                  int width, int height, int step);
+
+// Starts a streaming scan, which passes each region to "emit" with "ctx" as
+// it closes instead of adding it to a pool. Regions are emitted in the order
+// of their bottom edges, in preorder along a row, and the whole-image region
+// comes last.
+void scanner_init_streaming(scanner_t *scanner, scan_emit_fn emit, void *ctx,
+                            int width, int height, int step);
+
+// Run-length encodes the "width" pixels of "row", which are "step" bytes
+// apart, into "runs" and returns the number of runs. "runs" must have room
+// for "width" runs.
+int scan_encode_row(scan_run_t *runs, const uint8_t *row, int width, int step);
+
+// Scans the next row of the image, given as "count" runs.
+void scanner_feed_runs(scanner_t *scanner, const scan_run_t *runs, int count);
+
+// Scans the next row of the image.
+void scanner_feed_row(scanner_t *scanner, const uint8_t *row);
+
+// Closes the regions still open at the bottom of the image, sorts the pool
+// and frees the scanner's working memory.
+void scanner_finish(scanner_t *scanner);
+
+// Finds all regions located in "image" and adds them to "pool", without
+// modifying the image.
+void scan_regions(region_pool_t *pool, image_t *image);
+
+// As scan_regions(), but on "threads" threads (one per online processor if
+// "threads" is 0), each of which scans a band of the image's rows. The first
+// band is swept as usual; the others are swept as though no region were open
+// at their top, which finds the band's fragment of the regions. The bands are
+// then merged in order: the sweep goes on past each seam until the regions
+// open in it are those open at the same row of the band's sweep. From then
+// on the two sweeps are the same, so the band's regions are taken as they
+// are. Where regions close soon after a seam, little of each band is swept
+// twice; a band whose open regions never match is swept again in full.
+// The regions found, and their order in the pool, are the same as those of
+// scan_regions().
+void scan_regions_parallel(region_pool_t *pool, image_t *image, int threads);
+
+// Finds all regions in the P5 PGM image "filename" while reading it a few
+// rows at a time, passing each to "emit" with "ctx" as it closes (see
+// scanner_init_streaming()). The image is never held in memory. Returns
+// IMG_OK on success or an appropriate error code on failure.
+image_error_t scan_pgm_stream(const char *filename, scan_emit_fn emit,
+                              void *ctx);
+
+#endif
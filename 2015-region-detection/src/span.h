@@ -0,0 +1,99 @@
+#ifndef _SPAN_H_
+#define _SPAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#define SPAN_AVX2 1
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SPAN_SSE2 1
+#endif
+
+// Kernels that find where a run of one shade ends. They compare 32 (AVX2) or
+// 16 (SSE2) pixels at a time where the compiler targets those instruction
+// sets, and fall back to a plain loop elsewhere and for the tail of a run.
+// Every scan is bounded by an explicit length, so a run that reaches the edge
+// of the image stops there.
+
+// The number of pixels span_mismatch() tests one at a time before it starts
+// on vectors.
+enum {SPAN_SCALAR_HEAD = 16};
+
+// Returns the index of the first of the "n" contiguous pixels at "p" that is
+// not "shade", or "n" if they all are.
+static inline int span_mismatch(const uint8_t *p, int n, uint8_t shade)
+{
+  // most runs in a busy image are short; test those without vector setup
+  int i = 0;
+  const int head = n < SPAN_SCALAR_HEAD ? n : SPAN_SCALAR_HEAD;
+  for (; i < head; i++)
+  {
+    if (p[i] != shade)
+    {
+      return i;
+    }
+  }
+#if defined(SPAN_AVX2)
+  const __m256i v = _mm256_set1_epi8((char) shade);
+  for (; i + 32 <= n; i += 32)
+  {
+    __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (p + i)), v);
+    unsigned mask = ~(unsigned) _mm256_movemask_epi8(eq);
+    if (mask)
+    {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif defined(SPAN_SSE2)
+  const __m128i v = _mm_set1_epi8((char) shade);
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p + i)), v);
+    unsigned mask = ~(unsigned) _mm_movemask_epi8(eq) & 0xffff;
+    if (mask)
+    {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; i < n && p[i] == shade; i++);
+  return i;
+}
+
+// As span_mismatch(), but the pixels are "stride" bytes apart, as down a
+// column. A column cannot be loaded as a vector, so eight pixels are loaded
+// and compared together per step, which keeps the loads independent.
+static inline int column_mismatch(const uint8_t *p, ptrdiff_t stride, int n,
+                                  uint8_t shade)
+{
+  int i = 0;
+  for (; i + 8 <= n; i += 8, p += 8 * stride)
+  {
+    if ((p[0] ^ shade) | (p[stride] ^ shade) | (p[2 * stride] ^ shade) |
+        (p[3 * stride] ^ shade) | (p[4 * stride] ^ shade) |
+        (p[5 * stride] ^ shade) | (p[6 * stride] ^ shade) |
+        (p[7 * stride] ^ shade))
+    {
+      break;
+    }
+  }
+  for (; i < n && *p == shade; i++, p += stride);
+  return i;
+}
+
+// Returns the index of the first of "n" pixels, "step" bytes apart, that is
+// not "shade", or "n" if they all are.
+static inline int strided_mismatch(const uint8_t *p, int step, int n,
+                                   uint8_t shade)
+{
+  if (step == 1)
+  {
+    return span_mismatch(p, n, shade);
+  }
+  return column_mismatch(p, step, n, shade);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#include "image.h"
+#include "region.h"
+#include "scan.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// Prints each region to the FILE* in ctx as the scanner finishes it.
+static void print_closed_region(void *ctx, const region_t *region)
+{
+  print_region(ctx, region);
+}
+
+// Detects the regions of a PGM image of any size in memory proportional to
+// its width. Regions are printed as soon as their bottom edge has been read,
+// so they come out in order of their bottom edges rather than sorted.
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    fprintf(stderr, "Usage: %s input_image\n", argv[0]);
+    fprintf(stderr, "Regions are written to standard output as they are "
+            "found.\n");
+    return EXIT_FAILURE;
+  }
+
+  image_error_t img_err = scan_pgm_stream(argv[1], print_closed_region,
+                                          stdout);
+  if (img_err)
+  {
+    image_print_error(img_err);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,20 +1,29 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "image.h"
+#include "image_fast.h"
+#include "image_map.h"
 #include "dragon.h"
-
-#define MAX_RULE_LENGTH (63)
-#define MAX_AXIOM_LENGTH (63)
+#include "lsystem.h"
+#include "paperfold.h"
 
 // 0 for dragon, 1 for twin_dragon
 #define IMAGE_TYPE (1)
 
-/* x, y: coordinates of turtle */
-static long x, y;
+// 0 to expand the L-system, 1 to work out each segment's direction from its
+// index
+#ifndef RENDER_MODE
+#define RENDER_MODE (1)
+#endif
 
 /* When drawing a pixel to the image, x and y must be divided by this value.
  * This enables both the dragon curve and twin dragon to rendered without
@@ -22,78 +31,72 @@ static long x, y;
  */
 static long scale;
 
-/* drawn_pixels: the length of the path travelled. */
-static long drawn_pixels;
+/* turtle: the position and direction of the turtle, and the length of the
+ * path travelled. */
+static turtle_t turtle;
 
-/* direction: the current direction of the turtle. */
-static vector_t direction;
+/* curve: the axiom and rules of the curve being drawn. */
+static lsystem_t curve;
 
-char *axiom;
-char *xrule;
-char *yrule;
+/* blocks: the number of times "FX" appears in the curve's axiom. */
+static int blocks;
 
+/* threads: the number of threads to draw with, or 0 for one per online
+ * processor. */
+static int threads;
 
-/* set supplied vector to given values */
-static void set_vector(vector_t *vector, long x, long y) {
-  vector->dx = x;
-  vector->dy = y;
-}
+/* The number of levels of paperfold block a path can hold. */
+enum {PATH_LEVELS = CHAR_BIT * sizeof(unsigned long)};
 
-/* exit with error message */
-static void vector_error(long dx, long dy) {
-  fprintf(stderr, "Error: unexpected vector (%ld, %ld)\n", dx, dy);
-  exit(EXIT_FAILURE);
-}
+/* The path drawn without expanding the L-system: "blocks" blocks of "block"
+ * (2^levels) segments, the first starting at heading "start" after "drawn"
+ * points have already been drawn. moves[m][h] is how far 2^m segments of the
+ * paperfolding sequence move the turtle when the first heads h. The colour
+ * changes at each of run_ends[0 .. runs - 1]. */
+typedef struct path {
+  unsigned long block;
+  int levels;
+  int start;
+  long drawn;
+  vector_t moves[PATH_LEVELS][HEADINGS];
+  unsigned long run_ends[DEPTH + 1];
+  int runs;
+} path_t;
 
-/* rotate the supplied vector 45 degrees anti-clockwise */
-static void rotate(vector_t *vector) {
-  switch (vector->dx) {
-    case -1:
-      switch (vector->dy) {
-        case -1:
-          set_vector(vector, 0, -1); return;
-        case 0:
-          set_vector(vector, -1, -1); return;
-        case 1:
-          set_vector(vector, -1, 0); return;
-        default:
-          vector_error(vector->dx, vector->dy);
-      }
-    case 0:
-      switch (vector->dy) {
-        case -1:
-          set_vector(vector, 1, -1); return;
-        case 1:
-          set_vector(vector, -1, 1); return;
-        default:
-          vector_error(vector->dx, vector->dy);
-      }
-    case 1:
-      switch (vector->dy) {
-        case -1:
-          set_vector(vector, 1, 0); return;
-        case 0:
-          set_vector(vector, 1, 1); return;
-        case 1:
-          set_vector(vector, 0, 1); return;
-        default:
-          vector_error(vector->dx, vector->dy);
-      }
-    default:
-      vector_error(vector->dx, vector->dy);
-  }
-}
+/* The segments [first, end) of a path, drawn into dst by one thread. */
+typedef struct piece {
+  const path_t *path;
+  image_t *dst;
+  unsigned long first, end;
+} piece_t;
 
 /* Returns a vector that describes the initial direction of the turtle. Each
  * iteration corresponds to a 45 degree rotation of the turtle anti-clockwise.  */
 vector_t starting_direction(int total_iterations) {
-  vector_t dir = {1, 0};
-  for (int i = 0; i < total_iterations; ++i) {
-    rotate(&dir);
-  }
+  const int heading = total_iterations % HEADINGS;
+  vector_t dir = {heading_dx[heading], heading_dy[heading]};
   return dir;
 }
 
+/* Returns the colour of the point drawn after "drawn" points of the path in
+ * dst. */
+static uint8_t greyscale(const image_t *dst, long drawn) {
+  switch (LEVEL * drawn / (dst->height * dst->height)) {
+    case 0:
+      return 100;
+    case 1:
+      return 120;
+    case 2:
+      return 150;
+    case 3:
+      return 180;
+    case 4:
+      return 200;
+    default:
+      return 255;
+  }
+}
+
 /* Draws a pixel to dst at location (x, y). The pixel intensity is chosen as a
  * function of image size and the number of pixels drawn.
  *
@@ -102,110 +105,278 @@ vector_t starting_direction(int total_iterations) {
  * spatially.
  */
 void draw_greyscale(image_t *dst, long x, long y) {
-  uint8_t colour;
-  switch (LEVEL * drawn_pixels / (dst->height * dst->height)) {
-    case 0:
-      colour = 100; break;
-    case 1:
-      colour = 120; break;
-    case 2:
-      colour = 150; break;
-    case 3:
-      colour = 180; break;
-    case 4:
-      colour = 200; break;
-    default:
-      colour = 255; break;
-  }
-  set_pixel(dst, x, y, colour);
+  const uint8_t colour = greyscale(dst, turtle.drawn);
+  assert(x >= 0 && x < dst->width && y >= 0 && y < dst->height);
+  set_pixel_fast(dst, x, y, colour);
 }
 
 
-/* Iterates though the characters of str, recursively calling string_iteration()
- * until rules have been applied iterations times, or no rule is applicable.
- * and update the image.
+/* draws the turtle's current point to the image in ctx */
+static void draw_point(void *ctx, const turtle_t *t) {
+  draw_greyscale(ctx, t->x / scale, t->y / scale);
+}
+
+/* Iterates though the characters of str, applying the rules of the curve
+ * until they have been applied iterations times, or no rule is applicable,
+ * and updates the image. The expansion is done by lsystem_run() without
+ * recursion.
  */
 void string_iteration(image_t *dst, const char *str, int iterations) {
-  // iterations represents remaining iterations until termination
-  if (iterations == 0) { return; }
-
-  //printf("String = %s, iterations = %d\n", str, iterations);
-  char c;
-
-  while ((c = *(str++))) {
-    switch (c) {
-      // NOTE: first two cases switched, the spec appears to be wrong
-      case '+':
-        // rotate 90 deg clockwise ( = 270 deg anti-clockwise )
-        for (int i = 0; i++ < 6; rotate(&direction));
-        break;
-      case '-':
-        // rotate 90 deg anti-clockwise
-        for (int i = 0; i++ < 2; rotate(&direction));
-        break;
-      case 'F':
-        drawn_pixels++;
-        draw_greyscale(dst, x / scale, y / scale);
-        x += direction.dx;
-        y += direction.dy;
-        break;
-      case 'X':
-        string_iteration(dst, xrule, iterations - 1);
-        break;
-      case 'Y':
-        string_iteration(dst, yrule, iterations - 1);
-        break;
-      default:
-        perror("Unexpected character");
-        exit(EXIT_FAILURE);
+  const int c = lsystem_run(&curve, str, iterations, &turtle, draw_point,
+                            dst);
+  if (c != 0) {
+    fprintf(stderr, "Error: unexpected character '%c'\n", c);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* Returns the heading of segment k of path. Each block of the axiom traces
+ * the paperfolding sequence from its first segment, and the '+' after it is
+ * the turn the sequence would take next.
+ */
+static int segment_heading(const path_t *path, unsigned long k) {
+  const int turn = curve.plus_turn;
+  const int block_turn = paperfold_heading(path->block, 0, turn);
+  const int start = path->start + (k / path->block) * block_turn;
+  return paperfold_heading(k & (path->block - 1), start, turn);
+}
+
+/* Fills in path->moves. The second half of a block of 2^(m + 1) segments is
+ * the first half backwards, turned once more, so it moves the turtle as far
+ * as a block of 2^m segments starting one turn later.
+ */
+static void path_moves(path_t *path) {
+  const int turn = curve.plus_turn;
+  for (int h = 0; h < HEADINGS; h++) {
+    path->moves[0][h].dx = heading_dx[h];
+    path->moves[0][h].dy = heading_dy[h];
+  }
+  for (int m = 0; m < path->levels; m++) {
+    for (int h = 0; h < HEADINGS; h++) {
+      const int next = (unsigned) (h + turn) % HEADINGS;
+      const vector_t *turned = &path->moves[m][next];
+      path->moves[m + 1][h].dx = path->moves[m][h].dx + turned->dx;
+      path->moves[m + 1][h].dy = path->moves[m][h].dy + turned->dy;
+    }
+  }
+}
+
+/* Returns how far the first k segments of path move the turtle, in
+ * O(log k) steps. The segments before k within its block split, at each set
+ * bit b of k's offset, into a block of 2^b segments that shares k's higher
+ * bits; their Gray codes share those bits' too, so the block is the
+ * paperfolding sequence from 0 turned by as many turns as its first segment.
+ */
+static vector_t path_offset(const path_t *path, unsigned long k) {
+  const int turn = curve.plus_turn;
+  vector_t offset = {0, 0};
+  int start = path->start;
+  for (unsigned long b = 0; b < k / path->block; b++) {
+    offset.dx += path->moves[path->levels][start].dx;
+    offset.dy += path->moves[path->levels][start].dy;
+    start = paperfold_heading(path->block, start, turn);
+  }
+
+  const unsigned long rest = k & (path->block - 1);
+  for (int b = 0; b < path->levels; b++) {
+    if (rest & (1UL << b)) {
+      const unsigned long higher = rest & ~((2UL << b) - 1);
+      const int heading = paperfold_heading(higher, start, turn);
+      offset.dx += path->moves[b][heading].dx;
+      offset.dy += path->moves[b][heading].dy;
     }
   }
+  return offset;
+}
+
+/* Sets the pixel of dst at (x, y) to colour unless it already holds a
+ * brighter one. The colours never go down along the path, so the brightest
+ * is the last drawn there, whichever piece's thread gets there last.
+ */
+static void draw_brightest(image_t *dst, long x, long y, uint8_t colour) {
+  uint8_t *pixel = image_row(dst, y) + x * dst->nChannels;
+#ifdef __GNUC__
+  uint8_t seen = __atomic_load_n(pixel, __ATOMIC_RELAXED);
+  while (seen < colour &&
+         !__atomic_compare_exchange_n(pixel, &seen, colour, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+#else
+  if (*pixel < colour) {
+    *pixel = colour;
+  }
+#endif
+}
+
+/* Draws a piece of the path, starting from where the segments before it
+ * leave the turtle. */
+static void *walk_piece(void *arg) {
+  const piece_t *piece = arg;
+  const path_t *path = piece->path;
+  const vector_t offset = path_offset(path, piece->first);
+  long x = turtle.x + offset.dx, y = turtle.y + offset.dy;
+
+  int run = 0;
+  while (path->run_ends[run] <= piece->first) {
+    run++;
+  }
+  for (unsigned long k = piece->first; k < piece->end; run++) {
+    const uint8_t colour = greyscale(piece->dst, path->drawn + k + 1);
+    const unsigned long end = path->run_ends[run] < piece->end ?
+                              path->run_ends[run] : piece->end;
+    for (; k < end; k++) {
+      assert(x / scale >= 0 && x / scale < piece->dst->width &&
+             y / scale >= 0 && y / scale < piece->dst->height);
+      if (threads > 1) {
+        draw_brightest(piece->dst, x / scale, y / scale, colour);
+      } else {
+        set_pixel_fast(piece->dst, x / scale, y / scale, colour);
+      }
+      const int heading = segment_heading(path, k);
+      x += heading_dx[heading];
+      y += heading_dy[heading];
+    }
+  }
+  return NULL;
+}
+
+/* Draws the same path as string_iteration() does for the curve's axiom,
+ * without expanding it, on "threads" threads.
+ *
+ * The path is split evenly between the threads, and each works out where its
+ * piece starts from the piece's first index, so they all start at once. The
+ * pieces may cross, but draw_brightest() leaves each pixel as the last
+ * segment through it would, and the image is the same as string_iteration()
+ * draws. A single thread draws in order, so it stores the pixels plainly.
+ */
+static void closed_form_iteration(image_t *dst, int total_iterations) {
+  if (total_iterations <= 0) {
+    return;
+  }
+  path_t path;
+  path.levels = total_iterations - 1;
+  path.block = 1UL << path.levels;
+  path.start = turtle.heading;
+  path.drawn = turtle.drawn;
+  path_moves(&path);
+  const unsigned long length = blocks * path.block;
+
+#ifdef __GNUC__
+  if (threads <= 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? online : 1;
+  }
+#else
+  // without atomic pixels, crossing pieces must be drawn in order
+  threads = 1;
+#endif
+
+  // find the runs of each colour; the colours never go down, so each is a
+  // single run, and its end is found by bisection
+  path.runs = 0;
+  for (unsigned long first = 0; first < length; path.runs++) {
+    const uint8_t colour = greyscale(dst, path.drawn + first + 1);
+    unsigned long lo = first + 1, hi = length;
+    while (lo < hi) {
+      const unsigned long mid = lo + (hi - lo) / 2;
+      if (greyscale(dst, path.drawn + mid + 1) == colour) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    path.run_ends[path.runs] = first = lo;
+  }
+
+  piece_t *pieces = malloc(threads * sizeof(piece_t));
+  pthread_t *ids = malloc(threads * sizeof(pthread_t));
+  if (pieces == NULL || ids == NULL) {
+    perror("closed_form_iteration");
+    exit(EXIT_FAILURE);
+  }
+  for (int t = 0; t < threads; t++) {
+    pieces[t].path = &path;
+    pieces[t].dst = dst;
+    pieces[t].first = length * t / threads;
+    pieces[t].end = length * (t + 1) / threads;
+  }
+
+  // the calling thread draws the first piece itself
+  for (int t = 1; t < threads; t++) {
+    if (pthread_create(&ids[t], NULL, walk_piece, &pieces[t])) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  walk_piece(&pieces[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(ids[t], NULL);
+  }
+
+  // leave the turtle at the end of the path
+  const vector_t offset = path_offset(&path, length);
+  turtle.x += offset.dx;
+  turtle.y += offset.dy;
+  turtle.drawn += length;
+  turtle.heading = segment_heading(&path, length);
+  free(pieces);
+  free(ids);
 }
 
 /* Creates an image of requested size, calls starting_direction() to compute
- * initial turtle direction then calls string_iteration() to construct the
- * image. The constructed image is saved to a file in the output directory.
+ * initial turtle direction then calls string_iteration(), or draws the same
+ * segments from their indices, to construct the image. The image is mapped
+ * from its file in the output directory, so it is saved as it is drawn.
  */
 void dragon(long size, int total_iterations) {
-  axiom = malloc(MAX_AXIOM_LENGTH + 1);
-  xrule = malloc(MAX_RULE_LENGTH + 1);
-  yrule = malloc(MAX_RULE_LENGTH + 1);
-  char *out = malloc(64);
+  const char *out;
 
   // initialisation settings vary depending on image type
+  // '+' turns 90 degrees clockwise, '-' 90 degrees anti-clockwise
+  // (NOTE: the spec appears to have these the wrong way round)
+  curve.plus_turn = -2;
+  curve.minus_turn = 2;
   if (IMAGE_TYPE == 0) {
     // dragon
-    strcpy(axiom, "FX");
-    strcpy(xrule, "X+YF+");
-    strcpy(yrule, "-FX-Y");
+    curve.axiom = "FX";
+    curve.rules['X'] = "X+YF+";
+    curve.rules['Y'] = "-FX-Y";
     scale = 1;
-    strcpy(out, "../output/jurassicdragon.pgm");
-    x = size / 3;
-    y = size / 3;
+    blocks = 1;
+    out = "../output/jurassicdragon.pgm";
+    turtle.x = size / 3;
+    turtle.y = size / 3;
   } else {
     // twin dragon
-    strcpy(axiom, "FX+FX+");
-    strcpy(xrule, "X+YF");
-    strcpy(yrule, "FX-Y");
+    curve.axiom = "FX+FX+";
+    curve.rules['X'] = "X+YF";
+    curve.rules['Y'] = "FX-Y";
     scale = 2;
-    strcpy(out, "../output/twindragon.pgm");
-    x = size;
-    y = size;
+    blocks = 2;
+    out = "../output/twindragon.pgm";
+    turtle.x = size;
+    turtle.y = size;
   }
 
-  // create an image
+  // create the output image mapped in memory, so the curve is drawn
+  // straight into the file
   image_t *image;
-  image_error_t status = init_image(&image, 1.5 * size, size, 1, 255);
+  image_error_t status = image_map_create(out, &image, 1.5 * size, size,
+                                          PGM_FORMAT);
   if (status != IMG_OK) {
     fprintf(stderr, "Error initialising image. \n");
     image_print_error(status);
     exit(EXIT_FAILURE);
   }
 
-  string_iteration(image, axiom, total_iterations);
+  if (RENDER_MODE == 0) {
+    string_iteration(image, curve.axiom, total_iterations);
+  } else {
+    closed_form_iteration(image, total_iterations);
+  }
 
   // save image
-  status = image_write(out, image, PGM_FORMAT);
+  status = image_unmap(image);
   if (status != IMG_OK) {
     fprintf(stderr, "Error saving image. \n");
     image_print_error(status);
@@ -214,7 +385,9 @@ void dragon(long size, int total_iterations) {
 }
 
 /* The main function. When called with an argument, this should be considered
- * the number of iterations to execute. Otherwise, it is assumed to be 9. Image
+ * the number of iterations to execute. Otherwise, it is assumed to be 9. A
+ * second argument sets the number of threads to draw with; by default there
+ * is one per online processor. Image
  * size is computed from the number of iterations then dragon() is used to
  * generate the dragon image. */
 int main(int argc, char **argv) {
@@ -224,9 +397,14 @@ int main(int argc, char **argv) {
     iterations = atoi(argv[1]);
     assert(iterations > 0);
   }
+  if (argc > 2) {
+    threads = atoi(argv[2]);
+    assert(threads > 0);
+  }
   printf("Iterations: %u\n", iterations);
   long size = pow(2, iterations);
-  direction = starting_direction(iterations);
+  vector_t start = starting_direction(iterations);
+  turtle.heading = heading_of(start.dx, start.dy);
 
   // To keep the correct resolution of the curves at rendering time
   //    the total number of iterations, total_iterations, should be twice the
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "lsystem.h"
+
+const long heading_dx[HEADINGS] = {1, 1, 0, -1, -1, -1, 0, 1};
+const long heading_dy[HEADINGS] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+/* A string being read, and the level it is read at. */
+typedef struct frame {
+  const char *next;
+  int level;
+} frame_t;
+
+/* exit with error message if allocation failed */
+static void *check_alloc(void *p) {
+  if (p == NULL) {
+    perror("lsystem_run");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+/* the heading after turning by turn from heading, both in 45 degree steps */
+static int turned(int heading, int turn) {
+  return (heading + turn % HEADINGS + HEADINGS) % HEADINGS;
+}
+
+int heading_of(long dx, long dy) {
+  for (int h = 0; h < HEADINGS; h++) {
+    if (heading_dx[h] == dx && heading_dy[h] == dy) {
+      return h;
+    }
+  }
+  return -1;
+}
+
+int lsystem_run(const lsystem_t *system, const char *str, int iterations,
+                turtle_t *turtle, lsystem_draw_fn draw, void *ctx) {
+  if (iterations <= 0) {
+    return 0;
+  }
+
+  // a rule is only pushed above a frame of a higher level, so there are never
+  // more frames than levels
+  frame_t *stack = check_alloc(malloc(iterations * sizeof(frame_t)));
+  int top = 0;
+  stack[0].next = str;
+  stack[0].level = iterations;
+
+  // positions saved by '[', grown as needed
+  turtle_t *saved = NULL;
+  int saved_count = 0, saved_capacity = 0;
+
+  int error = 0;
+  while (top >= 0 && !error) {
+    frame_t *frame = &stack[top];
+    const unsigned char c = *frame->next;
+    if (c == '\0') {
+      top--;
+      continue;
+    }
+    frame->next++;
+
+    if (system->rules[c] != NULL) {
+      if (frame->level > 1) {
+        stack[top + 1].next = system->rules[c];
+        stack[top + 1].level = frame->level - 1;
+        top++;
+      }
+      continue;
+    }
+
+    switch (c) {
+      case 'F':
+        turtle->drawn++;
+        draw(ctx, turtle);
+        // fall through
+      case 'f':
+        turtle->x += heading_dx[turtle->heading];
+        turtle->y += heading_dy[turtle->heading];
+        break;
+      case '+':
+        turtle->heading = turned(turtle->heading, system->plus_turn);
+        break;
+      case '-':
+        turtle->heading = turned(turtle->heading, system->minus_turn);
+        break;
+      case '[':
+        if (saved_count == saved_capacity) {
+          saved_capacity = 2 * saved_capacity + 16;
+          saved = check_alloc(realloc(saved,
+                                      saved_capacity * sizeof(turtle_t)));
+        }
+        saved[saved_count++] = *turtle;
+        break;
+      case ']':
+        if (saved_count > 0) {
+          const long drawn = turtle->drawn;
+          *turtle = saved[--saved_count];
+          turtle->drawn = drawn;
+        }
+        break;
+      default:
+        error = c;
+    }
+  }
+
+  free(stack);
+  free(saved);
+  return error;
+}
@@ -0,0 +1,64 @@
+#ifndef LSYSTEM_H_
+#define LSYSTEM_H_
+
+#include <limits.h>
+
+/* An L-system and a turtle that draws it.
+ *
+ * Symbols with a rule are replaced by it until the requested number of
+ * iterations has been applied; at the last iteration they are dropped. The
+ * others are turtle commands:
+ *
+ *   F  draw the current point, then step forward
+ *   f  step forward without drawing
+ *   +  turn by plus_turn
+ *   -  turn by minus_turn
+ *   [  save the turtle's position and heading
+ *   ]  return to the last saved position and heading
+ *
+ * The expansion is walked depth first with an explicit stack of one frame per
+ * iteration, so the expanded string is never built and the C stack does not
+ * grow with the number of iterations.
+ */
+
+/* Headings are multiples of 45 degrees anti-clockwise from (1, 0). */
+enum {HEADINGS = 8};
+
+extern const long heading_dx[HEADINGS];
+extern const long heading_dy[HEADINGS];
+
+typedef struct lsystem
+{
+  const char *axiom;
+  /* rules[c] replaces the symbol c, or is NULL if c is a command */
+  const char *rules[UCHAR_MAX + 1];
+  /* turns, in 45 degree steps anti-clockwise, made by '+' and '-' */
+  int plus_turn;
+  int minus_turn;
+} lsystem_t;
+
+typedef struct turtle
+{
+  long x, y;
+  int heading;
+  /* the number of points drawn so far */
+  long drawn;
+} turtle_t;
+
+/* Called for each 'F' with the turtle at the point to draw, before it steps
+ * forward. turtle->drawn already counts this point. */
+typedef void (*lsystem_draw_fn)(void *ctx, const turtle_t *turtle);
+
+/* Returns the heading of the unit vector (dx, dy), or -1 if it is not one of
+ * the eight. */
+int heading_of(long dx, long dy);
+
+/* Moves turtle along str, usually system->axiom, calling draw for each point
+ * drawn. str is read at level "iterations"; a symbol with a rule read at
+ * level k is replaced by the rule read at level k - 1, or dropped if k is 1.
+ * Nothing is drawn for 0 iterations. Returns 0, or the first symbol that is
+ * neither a command nor has a rule; the turtle is left where it was found. */
+int lsystem_run(const lsystem_t *system, const char *str, int iterations,
+                turtle_t *turtle, lsystem_draw_fn draw, void *ctx);
+
+#endif /* LSYSTEM_H_ */
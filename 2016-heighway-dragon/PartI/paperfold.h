@@ -0,0 +1,40 @@
+#ifndef PAPERFOLD_H_
+#define PAPERFOLD_H_
+
+#include "lsystem.h"
+
+/* The turns of the Heighway dragon, taken segment by segment, are the regular
+ * paperfolding sequence: the turn between segments k - 1 and k is the same
+ * way as the first if the odd part of k is 1 mod 4, and the other way if it
+ * is 3 mod 4. The turns the other way cancel out, so segment k points
+ * popcount(k ^ (k >> 1)) first turns away from segment 0. Both follow from
+ * the bits of k alone, so any segment can be drawn without the ones before.
+ */
+
+static inline int paperfold_popcount(unsigned long v) {
+#ifdef __GNUC__
+  return __builtin_popcountl(v);
+#else
+  int n = 0;
+  for (; v != 0; v &= v - 1) {
+    n++;
+  }
+  return n;
+#endif
+}
+
+/* Returns 1 if the turn between segments k - 1 and k (k >= 1) is the same way
+ * as the first turn, or -1 if it is the other way. */
+static inline int paperfold_turn(unsigned long k) {
+  // the bit above the lowest set bit is that of 2 in the odd part
+  return (k & (k & -k) << 1) ? -1 : 1;
+}
+
+/* Returns the heading of segment k, given the heading of segment 0 and the
+ * first turn, in 45 degree steps anti-clockwise. */
+static inline int paperfold_heading(unsigned long k, int start, int turn) {
+  const int turns = paperfold_popcount(k ^ (k >> 1));
+  return (unsigned) (start + turn * turns) % HEADINGS;
+}
+
+#endif /* PAPERFOLD_H_ */